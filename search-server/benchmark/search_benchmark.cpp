@@ -0,0 +1,411 @@
+// Benchmarks of SearchServer on a seeded Zipf corpus, results as JSON.
+//
+// Built from the search-server directory with `make benchmark`, which runs
+//   g++ -std=c++17 -O2 benchmark/search_benchmark.cpp benchmark/zipf_corpus.cpp
+//       $(ls *.cpp | grep -v main.cpp) -o search_benchmark -ltbb -lpthread
+// Timings are comparable only between builds with the same flags.
+//
+//   search_benchmark [--documents N] [--queries N] [--vocabulary N] [--zipf S]
+//                    [--seed N] [--repetitions N] [--threads 1,2,4,...] [--output FILE]
+//
+// Every case runs --repetitions times and reports the median and the minimum
+// time per operation. The corpus options and the seed are written with the
+// results, so two runs with the same options can be diffed across versions.
+// The thread sweep limits the TBB pool behind std::execution::par.
+// Built with -DSEARCH_SERVER_PERF the results also hold the CPU counters of
+// add_document and find_top_documents/seq per stage and query class.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tbb/global_control.h>
+
+#include "../process_queries.h"
+#include "../remove_duplicates.h"
+#include "../search_server.h"
+#include "zipf_corpus.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct BenchmarkResult
+	{
+		std::string name;
+		size_t threads;
+		size_t operations;
+		std::vector<double> seconds;
+
+		double Median() const
+		{
+			std::vector<double> sorted = seconds;
+			std::sort(sorted.begin(), sorted.end());
+			return sorted[sorted.size() / 2];
+		}
+
+		double Min() const { return *std::min_element(seconds.begin(), seconds.end()); }
+	};
+
+	struct MemoryResult
+	{
+		std::string index;
+		MemoryStats stats;
+	};
+
+	class BenchmarkRunner
+	{
+	public:
+		explicit BenchmarkRunner(size_t repetitions) : repetitions_(repetitions) {}
+
+		// prepare runs before every repetition and is not timed
+		void Run(const std::string& name, size_t threads, size_t operations,
+			const std::function<void()>& body, const std::function<void()>& prepare = {})
+		{
+			BenchmarkResult result{ name, threads, operations, {} };
+			for (size_t i = 0; i < repetitions_; ++i)
+			{
+				if (prepare)
+				{
+					prepare();
+				}
+				const Clock::time_point start = Clock::now();
+				body();
+				result.seconds.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+			}
+			std::cerr << std::left << std::setw(40) << name << " threads " << std::setw(3) << threads
+				<< std::right << std::fixed << std::setprecision(1) << std::setw(12)
+				<< result.Median() * 1e9 / std::max<size_t>(operations, 1) << " ns/op" << std::endl;
+			results_.push_back(std::move(result));
+		}
+
+		const std::vector<BenchmarkResult>& GetResults() const { return results_; }
+
+	private:
+		const size_t repetitions_;
+		std::vector<BenchmarkResult> results_;
+	};
+
+	std::unique_ptr<SearchServer> BuildIndex(const Corpus& corpus, IndexOptions options)
+	{
+		auto search_server = std::make_unique<SearchServer>(corpus.stop_words, options);
+		for (size_t id = 0; id < corpus.documents.size(); ++id)
+		{
+			search_server->AddDocument(static_cast<int>(id), corpus.documents[id], DocumentStatus::ACTUAL, corpus.ratings[id]);
+		}
+		return search_server;
+	}
+
+	// Two neighbouring words of a document, quoted
+	std::vector<std::string> MakePhraseQueries(const Corpus& corpus, size_t count)
+	{
+		std::vector<std::string> queries;
+		for (size_t i = 0; i < corpus.documents.size() && queries.size() < count; i += 7)
+		{
+			std::istringstream words(corpus.documents[i]);
+			std::string first;
+			std::string second;
+			if (words >> first >> second)
+			{
+				queries.push_back("\""s + first + " "s + second + "\""s);
+			}
+		}
+		return queries;
+	}
+
+	std::vector<size_t> ParseThreadList(const std::string& text)
+	{
+		std::vector<size_t> threads;
+		std::istringstream in(text);
+		for (std::string item; std::getline(in, item, ',');)
+		{
+			threads.push_back(std::stoul(item));
+		}
+		return threads;
+	}
+
+	std::vector<size_t> DefaultThreadList()
+	{
+		const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+		std::vector<size_t> threads;
+		for (size_t count = 1; count < hardware; count *= 2)
+		{
+			threads.push_back(count);
+		}
+		threads.push_back(hardware);
+		return threads;
+	}
+
+	void WritePerfJson(std::ostream& out, const PerfProfile& profile)
+	{
+		out << "  \"perf\": {\"unavailable_reason\": \"" << profile.unavailable_reason << "\", \"available\": {";
+		for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+		{
+			out << "\"" << ToString(static_cast<PerfEvent>(i)) << "\": " << (profile.available[i] ? "true" : "false")
+				<< (i + 1 < PERF_EVENT_COUNT ? ", " : "");
+		}
+		out << "},\n    \"stages\": [\n";
+		for (size_t i = 0; i < profile.entries.size(); ++i)
+		{
+			const PerfProfileEntry& entry = profile.entries[i];
+			out << "      {\"stage\": \"" << ToString(entry.stage) << "\", \"class\": \"" << ToString(entry.query_class)
+				<< "\", \"calls\": " << entry.counts.calls;
+			for (int e = 0; e < PERF_EVENT_COUNT; ++e)
+			{
+				out << ", \"" << ToString(static_cast<PerfEvent>(e)) << "\": " << entry.counts.values[e];
+			}
+			out << "}" << (i + 1 < profile.entries.size() ? ",\n" : "\n");
+		}
+		out << "    ]},\n";
+	}
+
+	void WriteJson(std::ostream& out, const CorpusOptions& options, size_t repetitions,
+		const std::vector<BenchmarkResult>& results, const std::vector<MemoryResult>& memory,
+		const PerfProfile* perf_profile)
+	{
+		out << std::setprecision(17);
+		out << "{\n  \"format\": 1,\n";
+		out << "  \"corpus\": {\"seed\": " << options.seed
+			<< ", \"vocabulary_size\": " << options.vocabulary_size
+			<< ", \"zipf_exponent\": " << options.zipf_exponent
+			<< ", \"stop_word_count\": " << options.stop_word_count
+			<< ", \"document_count\": " << options.document_count
+			<< ", \"query_count\": " << options.query_count << "},\n";
+		out << "  \"repetitions\": " << repetitions << ",\n";
+		out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+
+		out << "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const BenchmarkResult& result = results[i];
+			const double operations = static_cast<double>(std::max<size_t>(result.operations, 1));
+			out << "    {\"name\": \"" << result.name << "\", \"threads\": " << result.threads
+				<< ", \"operations\": " << result.operations
+				<< ", \"median_ns_per_op\": " << result.Median() * 1e9 / operations
+				<< ", \"min_ns_per_op\": " << result.Min() * 1e9 / operations
+				<< ", \"median_seconds\": " << result.Median() << "}"
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ],\n";
+
+		if (perf_profile != nullptr)
+		{
+			WritePerfJson(out, *perf_profile);
+		}
+
+		out << "  \"memory\": [\n";
+		for (size_t i = 0; i < memory.size(); ++i)
+		{
+			out << "    {\"index\": \"" << memory[i].index << "\", \"total_bytes\": " << memory[i].stats.TotalBytes()
+				<< ", \"containers\": {";
+			const auto& containers = memory[i].stats.containers;
+			for (size_t c = 0; c < containers.size(); ++c)
+			{
+				out << "\"" << containers[c].name << "\": " << containers[c].Bytes() << (c + 1 < containers.size() ? ", " : "");
+			}
+			out << "}}" << (i + 1 < memory.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	CorpusOptions options;
+	size_t repetitions = 5;
+	std::vector<size_t> thread_counts = DefaultThreadList();
+	std::string output_path;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string option = argv[i];
+		const std::string value = argv[i + 1];
+		if (option == "--documents"s)
+		{
+			options.document_count = std::stoul(value);
+		}
+		else if (option == "--queries"s)
+		{
+			options.query_count = std::stoul(value);
+		}
+		else if (option == "--vocabulary"s)
+		{
+			options.vocabulary_size = std::stoul(value);
+		}
+		else if (option == "--zipf"s)
+		{
+			options.zipf_exponent = std::stod(value);
+		}
+		else if (option == "--seed"s)
+		{
+			options.seed = std::stoull(value);
+		}
+		else if (option == "--repetitions"s)
+		{
+			repetitions = std::max<size_t>(1, std::stoul(value));
+		}
+		else if (option == "--threads"s)
+		{
+			thread_counts = ParseThreadList(value);
+		}
+		else if (option == "--output"s)
+		{
+			output_path = value;
+		}
+		else
+		{
+			std::cerr << "Unknown option "s << option << std::endl;
+			return 1;
+		}
+	}
+
+	const Corpus corpus = GenerateCorpus(options);
+	const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+	const size_t document_count = corpus.documents.size();
+	const size_t query_count = corpus.queries.size();
+	const size_t match_count = std::min<size_t>(query_count, document_count);
+	const size_t remove_count = std::min<size_t>(2000, document_count);
+
+	IndexOptions index_options;
+	index_options.store_content = false;
+	BenchmarkRunner runner(repetitions);
+
+	const PerfProfile* perf_profile = nullptr;
+#ifdef SEARCH_SERVER_PERF
+	PerfProfiler::Reset();
+#endif
+
+	std::unique_ptr<SearchServer> search_server;
+	runner.Run("add_document", 1, document_count,
+		[&] { search_server = BuildIndex(corpus, index_options); },
+		[&] { search_server.reset(); });
+
+	runner.Run("find_top_documents/seq", 1, query_count, [&]
+		{
+			for (const std::string& query : corpus.queries)
+			{
+				search_server->FindTopDocuments(std::execution::seq, query);
+			}
+		});
+#ifdef SEARCH_SERVER_PERF
+	const PerfProfile sequential_profile = PerfProfiler::Collect();
+	perf_profile = &sequential_profile;
+#endif
+	runner.Run("find_top_documents/adaptive", hardware, query_count, [&]
+		{
+			for (const std::string& query : corpus.queries)
+			{
+				search_server->FindTopDocuments(adaptive_execution, query);
+			}
+		});
+	runner.Run("find_top_documents_bm25/seq", 1, query_count, [&]
+		{
+			for (const std::string& query : corpus.queries)
+			{
+				search_server->FindTopDocuments<Bm25Scorer>(std::execution::seq, query);
+			}
+		});
+
+	runner.Run("match_document/seq", 1, match_count, [&]
+		{
+			for (size_t i = 0; i < match_count; ++i)
+			{
+				search_server->MatchDocument(std::execution::seq, corpus.queries[i], static_cast<int>(i));
+			}
+		});
+	runner.Run("match_document/par", hardware, match_count, [&]
+		{
+			for (size_t i = 0; i < match_count; ++i)
+			{
+				search_server->MatchDocument(std::execution::par, corpus.queries[i], static_cast<int>(i));
+			}
+		});
+
+	// Thread scaling of the parallel paths
+	for (const size_t threads : thread_counts)
+	{
+		tbb::global_control limit(tbb::global_control::max_allowed_parallelism, threads);
+		runner.Run("find_top_documents/par", threads, query_count, [&]
+			{
+				for (const std::string& query : corpus.queries)
+				{
+					search_server->FindTopDocuments(std::execution::par, query);
+				}
+			});
+		runner.Run("process_queries", threads, query_count, [&]
+			{
+				ProcessQueries(*search_server, corpus.queries);
+			});
+	}
+
+	std::vector<MemoryResult> memory;
+	memory.push_back({ "plain"s, search_server->GetMemoryStats() });
+
+	std::unique_ptr<SearchServer> scratch;
+	runner.Run("remove_document/seq", 1, remove_count, [&]
+		{
+			for (size_t id = 0; id < remove_count; ++id)
+			{
+				scratch->RemoveDocument(std::execution::seq, static_cast<int>(id));
+			}
+		},
+		[&] { scratch = BuildIndex(corpus, index_options); });
+	runner.Run("remove_document/par", hardware, remove_count, [&]
+		{
+			for (size_t id = 0; id < remove_count; ++id)
+			{
+				scratch->RemoveDocument(std::execution::par, static_cast<int>(id));
+			}
+		},
+		[&] { scratch = BuildIndex(corpus, index_options); });
+
+	{
+		// RemoveDuplicates reports every duplicate on stdout
+		std::ostringstream sink;
+		std::streambuf* const stdout_buffer = std::cout.rdbuf(sink.rdbuf());
+		runner.Run("remove_duplicates", 1, document_count,
+			[&] { RemoveDuplicates(*scratch); },
+			[&] { scratch = BuildIndex(corpus, index_options); sink.str({}); });
+		std::cout.rdbuf(stdout_buffer);
+	}
+	scratch.reset();
+	search_server.reset();
+
+	// The positional index: build cost, memory and phrase queries
+	IndexOptions positional_options = index_options;
+	positional_options.store_positions = true;
+	runner.Run("add_document/positions", 1, document_count,
+		[&] { search_server = BuildIndex(corpus, positional_options); },
+		[&] { search_server.reset(); });
+	memory.push_back({ "positions"s, search_server->GetMemoryStats() });
+
+	const std::vector<std::string> phrase_queries = MakePhraseQueries(corpus, query_count);
+	runner.Run("find_top_documents_phrase/seq", 1, phrase_queries.size(), [&]
+		{
+			for (const std::string& query : phrase_queries)
+			{
+				search_server->FindTopDocuments(std::execution::seq, query);
+			}
+		});
+
+	if (output_path.empty())
+	{
+		WriteJson(std::cout, options, repetitions, runner.GetResults(), memory, perf_profile);
+	}
+	else
+	{
+		std::ofstream out(output_path);
+		WriteJson(out, options, repetitions, runner.GetResults(), memory, perf_profile);
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cmath>
+
+#include "zipf_corpus.h"
+
+namespace
+{
+	// Uniform in [0, 1) from the top 53 bits, unlike
+	// std::uniform_real_distribution this is the same everywhere
+	double NextUnit(std::mt19937_64& generator)
+	{
+		return static_cast<double>(generator() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	size_t NextInRange(std::mt19937_64& generator, size_t min, size_t max)
+	{
+		return min + static_cast<size_t>(generator() % (max - min + 1));
+	}
+}
+
+ZipfDistribution::ZipfDistribution(size_t size, double exponent) : cumulative_(size)
+{
+	double sum = 0.0;
+	for (size_t rank = 0; rank < size; ++rank)
+	{
+		// Division and addition are correctly rounded everywhere, std::pow is not
+		const double weight = static_cast<double>(rank + 1);
+		sum += 1.0 / (exponent == 1.0 ? weight : std::pow(weight, exponent));
+		cumulative_[rank] = sum;
+	}
+	for (double& value : cumulative_)
+	{
+		value /= sum;
+	}
+}
+
+size_t ZipfDistribution::operator()(std::mt19937_64& generator) const
+{
+	const auto it = std::upper_bound(cumulative_.begin(), cumulative_.end(), NextUnit(generator));
+	return std::min(static_cast<size_t>(it - cumulative_.begin()), cumulative_.size() - 1);
+}
+
+std::string MakeWord(size_t rank)
+{
+	std::string word;
+	do
+	{
+		word += static_cast<char>('a' + rank % 26);
+		rank /= 26;
+	} while (rank > 0);
+	return word;
+}
+
+Corpus GenerateCorpus(const CorpusOptions& options)
+{
+	std::mt19937_64 generator(options.seed);
+	const ZipfDistribution ranks(options.vocabulary_size, options.zipf_exponent);
+
+	Corpus corpus;
+	corpus.vocabulary.reserve(options.vocabulary_size);
+	for (size_t rank = 0; rank < options.vocabulary_size; ++rank)
+	{
+		corpus.vocabulary.push_back(MakeWord(rank));
+	}
+	for (size_t rank = 0; rank < std::min(options.stop_word_count, options.vocabulary_size); ++rank)
+	{
+		corpus.stop_words += corpus.vocabulary[rank];
+		corpus.stop_words += ' ';
+	}
+
+	corpus.documents.reserve(options.document_count);
+	corpus.ratings.reserve(options.document_count);
+	for (size_t i = 0; i < options.document_count; ++i)
+	{
+		if (!corpus.documents.empty() && NextUnit(generator) < options.duplicate_share)
+		{
+			// Same words in another order and count
+			const std::string& original = corpus.documents[generator() % corpus.documents.size()];
+			corpus.documents.push_back(original + " " + original.substr(0, original.find(' ')));
+		}
+		else
+		{
+			std::string document;
+			const size_t word_count = NextInRange(generator, options.min_document_words, options.max_document_words);
+			for (size_t w = 0; w < word_count; ++w)
+			{
+				if (w > 0)
+				{
+					document += ' ';
+				}
+				document += corpus.vocabulary[ranks(generator)];
+			}
+			corpus.documents.push_back(std::move(document));
+		}
+
+		std::vector<int> ratings(NextInRange(generator, 0, 5));
+		for (int& rating : ratings)
+		{
+			rating = static_cast<int>(NextInRange(generator, 0, 20)) - 10;
+		}
+		corpus.ratings.push_back(std::move(ratings));
+	}
+
+	corpus.queries.reserve(options.query_count);
+	for (size_t i = 0; i < options.query_count; ++i)
+	{
+		std::string query;
+		const size_t word_count = NextInRange(generator, options.min_query_words, options.max_query_words);
+		for (size_t w = 0; w < word_count; ++w)
+		{
+			if (w > 0)
+			{
+				query += ' ';
+			}
+			// The first word stays a plus-word so that every query can match
+			if (w > 0 && NextUnit(generator) < options.minus_word_share)
+			{
+				query += '-';
+			}
+			query += corpus.vocabulary[ranks(generator)];
+		}
+		corpus.queries.push_back(std::move(query));
+	}
+	return corpus;
+}
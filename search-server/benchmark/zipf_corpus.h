@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Seeded synthetic corpus for the benchmarks. Word ranks follow a Zipf law:
+// the word of rank r is drawn with probability proportional to 1 / r^exponent,
+// the most frequent ranks serve as stop words. The choices come from
+// std::mt19937_64 and IEEE arithmetic, so with the default exponent of 1.0 a
+// seed gives the same corpus with every standard library. Other exponents go
+// through std::pow and reproduce only with the same standard library.
+
+struct CorpusOptions
+{
+	uint64_t seed = 42;
+	size_t vocabulary_size = 50000;
+	double zipf_exponent = 1.0;
+	// The stop_word_count most frequent words
+	size_t stop_word_count = 20;
+
+	size_t document_count = 50000;
+	size_t min_document_words = 10;
+	size_t max_document_words = 80;
+	// Share of documents repeating the word set of an earlier one, for RemoveDuplicates
+	double duplicate_share = 0.05;
+
+	size_t query_count = 2000;
+	size_t min_query_words = 1;
+	size_t max_query_words = 5;
+	// Chance of every query word to be a minus-word
+	double minus_word_share = 0.15;
+};
+
+struct Corpus
+{
+	std::vector<std::string> vocabulary;
+	std::string stop_words;
+	std::vector<std::string> documents;
+	std::vector<std::vector<int>> ratings;
+	std::vector<std::string> queries;
+};
+
+class ZipfDistribution
+{
+public:
+	ZipfDistribution(size_t size, double exponent);
+
+	// Rank in [0, size), 0 being the most frequent
+	size_t operator()(std::mt19937_64& generator) const;
+
+private:
+	std::vector<double> cumulative_;
+};
+
+// Word of a rank: its number written with the letters a..z
+std::string MakeWord(size_t rank);
+
+Corpus GenerateCorpus(const CorpusOptions& options);
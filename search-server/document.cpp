@@ -7,6 +7,13 @@ Document::Document(int id, double relevance, int rating)
 {
 }
 
+SearchAfter::SearchAfter(const Document& last_document)
+    : relevance(last_document.relevance)
+    , rating(last_document.rating)
+    , id(last_document.id)
+{
+}
+
 std::ostream& operator<<(std::ostream& out, const Document& document)
 {
     out << "{ "s
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <iostream>
+#include <limits>
 
 
 using namespace std::string_literals;
@@ -20,6 +21,18 @@ std::ostream& operator<<(std::ostream& out, const Document& document);
 
 void PrintDocument(const Document& document);
 
+// Search-after cursor: a page continues strictly after this position of the
+// result order. The default cursor points before the first result.
+struct SearchAfter
+{
+    SearchAfter() = default;
+    explicit SearchAfter(const Document& last_document);
+
+    double relevance = std::numeric_limits<double>::infinity();
+    int rating = std::numeric_limits<int>::max();
+    int id = -1;
+};
+
 enum class DocumentStatus
 {
     ACTUAL,
@@ -0,0 +1,115 @@
+#include <stdexcept>
+
+#include "document_store.h"
+#include "lz_codec.h"
+
+using namespace std::string_literals;
+
+DocumentStore::DocumentStore(size_t block_size, const std::string& spill_path) :
+	block_size_(block_size), spill_(!spill_path.empty())
+{
+	if (spill_)
+	{
+		spill_file_.open(spill_path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+		if (!spill_file_)
+		{
+			throw std::runtime_error("Can't open document store file "s + spill_path);
+		}
+	}
+}
+
+void DocumentStore::Add(int document_id, std::string_view content)
+{
+	std::lock_guard g(mutex_);
+	if (!open_block_.empty() && open_block_.size() + content.size() > block_size_)
+	{
+		SealOpenBlock();
+	}
+
+	const Location location{ static_cast<uint32_t>(blocks_.size()), static_cast<uint32_t>(open_block_.size()),
+		static_cast<uint32_t>(content.size()) };
+	locations_[document_id] = location;
+	open_block_.append(content);
+	raw_bytes_ += content.size();
+}
+
+void DocumentStore::Remove(int document_id)
+{
+	std::lock_guard g(mutex_);
+	locations_.erase(document_id);
+}
+
+std::string DocumentStore::Get(int document_id) const
+{
+	std::lock_guard g(mutex_);
+	const Location& location = locations_.at(document_id);
+	if (location.block == blocks_.size())
+	{
+		return open_block_.substr(location.offset, location.size);
+	}
+	return LoadBlock(location.block).substr(location.offset, location.size);
+}
+
+ContainerMemory DocumentStore::GetMemoryUsage() const
+{
+	std::lock_guard g(mutex_);
+	ContainerMemory memory{ "content_store" };
+	memory.AddNodes<std::pair<const int, Location>>(locations_.size());
+	memory.AddAllocations(sizeof(Block) * blocks_.capacity());
+	for (const Block& block : blocks_)
+	{
+		memory.AddAllocations(StringHeapBytes(block.compressed));
+	}
+	memory.AddAllocations(StringHeapBytes(open_block_));
+	memory.AddAllocations(StringHeapBytes(cached_data_));
+	return memory;
+}
+
+void DocumentStore::SealOpenBlock()
+{
+	Block block{ spilled_bytes_, 0, LzCompress(open_block_) };
+	block.compressed_size = static_cast<uint32_t>(block.compressed.size());
+
+	if (spill_)
+	{
+		spill_file_.seekp(static_cast<std::streamoff>(block.file_offset));
+		spill_file_.write(block.compressed.data(), block.compressed.size());
+		if (!spill_file_)
+		{
+			throw std::runtime_error("Can't write document store file"s);
+		}
+		spilled_bytes_ += block.compressed_size;
+		block.compressed = std::string();
+	}
+
+	blocks_.push_back(std::move(block));
+	open_block_.clear();
+}
+
+const std::string& DocumentStore::LoadBlock(uint32_t block_index) const
+{
+	if (cached_block_ == block_index)
+	{
+		return cached_data_;
+	}
+
+	const Block& block = blocks_[block_index];
+	if (spill_)
+	{
+		std::string compressed(block.compressed_size, '\0');
+		spill_file_.seekg(static_cast<std::streamoff>(block.file_offset));
+		spill_file_.read(compressed.data(), compressed.size());
+		if (!spill_file_)
+		{
+			spill_file_.clear();
+			throw std::runtime_error("Can't read document store file"s);
+		}
+		cached_data_ = LzDecompress(compressed);
+	}
+	else
+	{
+		cached_data_ = LzDecompress(block.compressed);
+	}
+	cached_block_ = block_index;
+	return cached_data_;
+}
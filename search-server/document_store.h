@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memory_stats.h"
+
+// Document texts kept apart from the index. Texts are appended to an open
+// block; a full block is compressed with LzCompress and either kept in memory
+// or spilled to a file. Get decompresses a block on demand and caches the
+// last one, so reading neighbouring documents costs one decompression.
+class DocumentStore
+{
+public:
+	// An empty spill_path keeps the compressed blocks in memory
+	explicit DocumentStore(size_t block_size = 1 << 16, const std::string& spill_path = {});
+
+	void Add(int document_id, std::string_view content);
+
+	// The text stays inside its block, only the reference to it is dropped
+	void Remove(int document_id);
+
+	// Throws std::out_of_range for an unknown document
+	std::string Get(int document_id) const;
+
+	size_t GetDocumentCount() const { return locations_.size(); }
+
+	// Size of all texts ever added, uncompressed
+	uint64_t GetRawBytes() const { return raw_bytes_; }
+
+	// Locations, compressed blocks (unless spilled), the open block and the cache
+	ContainerMemory GetMemoryUsage() const;
+
+	// Compressed bytes written to the spill file
+	uint64_t GetSpilledBytes() const { return spilled_bytes_; }
+
+private:
+	struct Location
+	{
+		uint32_t block;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	struct Block
+	{
+		uint64_t file_offset;
+		uint32_t compressed_size;
+		// Empty when the block is spilled
+		std::string compressed;
+	};
+
+	const size_t block_size_;
+	const bool spill_;
+	std::map<int, Location> locations_;
+	std::vector<Block> blocks_;
+	std::string open_block_;
+	uint64_t raw_bytes_ = 0;
+	uint64_t spilled_bytes_ = 0;
+
+	mutable std::mutex mutex_;
+	mutable std::fstream spill_file_;
+	mutable uint32_t cached_block_ = UINT32_MAX;
+	mutable std::string cached_data_;
+
+	void SealOpenBlock();
+
+	// Needs mutex_ held
+	const std::string& LoadBlock(uint32_t block) const;
+};
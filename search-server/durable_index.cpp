@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "durable_index.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	// Snapshot file: magic, u64 sequence, then ADD_DOCUMENT records
+	const std::string_view SNAPSHOT_MAGIC = "SSSNAP01";
+	const size_t SNAPSHOT_HEADER_SIZE = 8 + sizeof(uint64_t);
+	const size_t SNAPSHOT_WRITE_CHUNK = 1 << 20;
+
+	std::system_error LastError(const std::string& what)
+	{
+		return std::system_error(errno, std::generic_category(), what);
+	}
+
+	void WriteAll(int fd, const std::string& data, const std::string& path)
+	{
+		for (size_t written = 0; written < data.size();)
+		{
+			const ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+			if (result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				throw LastError("Can't write "s + path);
+			}
+			written += static_cast<size_t>(result);
+		}
+	}
+
+	void SyncPath(const std::string& path, int flags)
+	{
+		const int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+		if (fd < 0)
+		{
+			throw LastError("Can't open "s + path);
+		}
+		const int result = ::fsync(fd);
+		::close(fd);
+		if (result != 0)
+		{
+			throw LastError("Can't sync "s + path);
+		}
+	}
+}
+
+DurableIndex::DurableIndex(const std::string& directory, const std::string& stop_words_text,
+	IndexOptions options, MutationLogOptions log_options) :
+	snapshot_path_((std::filesystem::path(directory) / "snapshot").string()),
+	log_path_((std::filesystem::path(directory) / "mutations.log").string()),
+	search_server_(stop_words_text, options)
+{
+	const auto start_time = std::chrono::steady_clock::now();
+	std::filesystem::create_directories(directory);
+
+	const uint64_t snapshot_sequence = LoadSnapshot();
+	uint64_t last_sequence = snapshot_sequence;
+	for (const LoggedMutation& record : MutationLog::Recover(log_path_))
+	{
+		// A crash between a snapshot and the log truncation leaves records it holds
+		if (record.sequence > snapshot_sequence)
+		{
+			Apply(record.mutation);
+			++recovery_stats_.replayed_mutations;
+		}
+		last_sequence = std::max(last_sequence, record.sequence);
+	}
+
+	log_ = std::make_unique<MutationLog>(log_path_, last_sequence, log_options);
+	recovery_stats_.duration = std::chrono::steady_clock::now() - start_time;
+}
+
+uint64_t DurableIndex::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+	const std::vector<int>& ratings)
+{
+	Mutation mutation;
+	mutation.type = MutationType::ADD_DOCUMENT;
+	mutation.document_id = document_id;
+	mutation.status = status;
+	mutation.ratings = ratings;
+	mutation.text = std::string(document);
+	return ApplyAndLog(mutation);
+}
+
+uint64_t DurableIndex::RemoveDocument(int document_id)
+{
+	Mutation mutation;
+	mutation.type = MutationType::REMOVE_DOCUMENT;
+	mutation.document_id = document_id;
+	return ApplyAndLog(mutation);
+}
+
+uint64_t DurableIndex::UpdateDocumentStatus(int document_id, DocumentStatus status)
+{
+	Mutation mutation;
+	mutation.type = MutationType::UPDATE_STATUS;
+	mutation.document_id = document_id;
+	mutation.status = status;
+	return ApplyAndLog(mutation);
+}
+
+uint64_t DurableIndex::UpdateDocumentRatings(int document_id, const std::vector<int>& ratings)
+{
+	Mutation mutation;
+	mutation.type = MutationType::UPDATE_RATINGS;
+	mutation.document_id = document_id;
+	mutation.ratings = ratings;
+	return ApplyAndLog(mutation);
+}
+
+void DurableIndex::SaveSnapshot()
+{
+	std::lock_guard g(mutation_mutex_);
+	const uint64_t sequence = log_->GetLastSequence();
+
+	const std::string temporary_path = snapshot_path_ + ".tmp"s;
+	const int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		throw LastError("Can't open "s + temporary_path);
+	}
+	try
+	{
+		std::string chunk(SNAPSHOT_MAGIC);
+		chunk.append(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+
+		Mutation mutation;
+		mutation.type = MutationType::ADD_DOCUMENT;
+		for (const int document_id : search_server_)
+		{
+			mutation.document_id = document_id;
+			mutation.status = search_server_.GetDocumentStatus(document_id);
+			mutation.ratings = { search_server_.GetDocumentRating(document_id) };
+			mutation.text = search_server_.GetDocumentContent(document_id);
+			AppendMutationRecord(chunk, sequence, mutation);
+			if (chunk.size() >= SNAPSHOT_WRITE_CHUNK)
+			{
+				WriteAll(fd, chunk, temporary_path);
+				chunk.clear();
+			}
+		}
+		WriteAll(fd, chunk, temporary_path);
+		if (::fsync(fd) != 0)
+		{
+			throw LastError("Can't sync "s + temporary_path);
+		}
+	}
+	catch (...)
+	{
+		::close(fd);
+		::unlink(temporary_path.c_str());
+		throw;
+	}
+	::close(fd);
+
+	if (::rename(temporary_path.c_str(), snapshot_path_.c_str()) != 0)
+	{
+		throw LastError("Can't rename "s + temporary_path);
+	}
+	SyncPath(std::filesystem::path(snapshot_path_).parent_path().string(), O_RDONLY | O_DIRECTORY);
+	log_->Truncate();
+}
+
+uint64_t DurableIndex::LoadSnapshot()
+{
+	std::ifstream in(snapshot_path_, std::ios::binary);
+	if (!in)
+	{
+		return 0;
+	}
+	const std::string data{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+	if (data.size() < SNAPSHOT_HEADER_SIZE || std::string_view(data).substr(0, SNAPSHOT_MAGIC.size()) != SNAPSHOT_MAGIC)
+	{
+		throw std::runtime_error("Snapshot "s + snapshot_path_ + " has no valid header"s);
+	}
+	uint64_t sequence = 0;
+	std::memcpy(&sequence, data.data() + SNAPSHOT_MAGIC.size(), sizeof(sequence));
+
+	// Snapshots are renamed into place only when complete, so any bad record is fatal
+	size_t valid_bytes = 0;
+	const std::vector<LoggedMutation> records =
+		ReadMutationRecords(std::string_view(data).substr(SNAPSHOT_HEADER_SIZE), valid_bytes);
+	if (SNAPSHOT_HEADER_SIZE + valid_bytes != data.size())
+	{
+		throw std::runtime_error("Snapshot "s + snapshot_path_ + " is corrupted"s);
+	}
+	for (const LoggedMutation& record : records)
+	{
+		Apply(record.mutation);
+	}
+	recovery_stats_.snapshot_documents = records.size();
+	return sequence;
+}
+
+void DurableIndex::Apply(const Mutation& mutation)
+{
+	switch (mutation.type)
+	{
+	case MutationType::ADD_DOCUMENT:
+		search_server_.AddDocument(mutation.document_id, mutation.text, mutation.status, mutation.ratings);
+		break;
+	case MutationType::REMOVE_DOCUMENT:
+		search_server_.RemoveDocument(mutation.document_id);
+		break;
+	case MutationType::UPDATE_STATUS:
+		search_server_.UpdateDocumentStatus(mutation.document_id, mutation.status);
+		break;
+	case MutationType::UPDATE_RATINGS:
+		search_server_.UpdateDocumentRatings(mutation.document_id, mutation.ratings);
+		break;
+	}
+}
+
+uint64_t DurableIndex::ApplyAndLog(const Mutation& mutation)
+{
+	std::lock_guard g(mutation_mutex_);
+	// Invalid mutations throw here and never reach the log
+	Apply(mutation);
+	return log_->Append(mutation);
+}
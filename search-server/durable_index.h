@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mutation_log.h"
+#include "search_server.h"
+
+// SearchServer that survives a restart. Every mutation is applied to the
+// index, then appended to a MutationLog in the directory. SaveSnapshot writes
+// all documents to a snapshot file and empties the log, so recovery loads the
+// snapshot and replays only the records logged after it.
+//
+// Mutations return the log sequence of their record; pass it to WaitDurable
+// before acknowledging the write to a client. Mutations are serialized, and
+// as with a plain SearchServer, queries must not run during AddDocument or
+// RemoveDocument. Snapshots need the document texts (IndexOptions::store_content).
+class DurableIndex
+{
+public:
+	struct RecoveryStats
+	{
+		size_t snapshot_documents = 0;
+		size_t replayed_mutations = 0;
+		std::chrono::steady_clock::duration duration{};
+	};
+
+	// Creates the directory if needed and recovers the index stored in it
+	DurableIndex(const std::string& directory, const std::string& stop_words_text,
+		IndexOptions options = {}, MutationLogOptions log_options = {});
+
+	const SearchServer& GetSearchServer() const { return search_server_; }
+
+	uint64_t AddDocument(int document_id, std::string_view document, DocumentStatus status,
+		const std::vector<int>& ratings);
+
+	uint64_t RemoveDocument(int document_id);
+
+	uint64_t UpdateDocumentStatus(int document_id, DocumentStatus status);
+
+	uint64_t UpdateDocumentRatings(int document_id, const std::vector<int>& ratings);
+
+	void WaitDurable(uint64_t sequence) { log_->WaitDurable(sequence); }
+
+	void Flush() { log_->Flush(); }
+
+	// Writes the snapshot next to the old one, renames it over and empties the log.
+	// Mutations wait while it runs
+	void SaveSnapshot();
+
+	const RecoveryStats& GetRecoveryStats() const { return recovery_stats_; }
+
+private:
+	const std::string snapshot_path_;
+	const std::string log_path_;
+	SearchServer search_server_;
+	std::unique_ptr<MutationLog> log_;
+	std::mutex mutation_mutex_;
+	RecoveryStats recovery_stats_;
+
+	// Returns the sequence the snapshot was taken at, 0 without a snapshot
+	uint64_t LoadSnapshot();
+
+	void Apply(const Mutation& mutation);
+
+	uint64_t ApplyAndLog(const Mutation& mutation);
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Log-linear histogram: every power of two is split into SUB_BUCKETS equal parts,
+// so any recorded value is off by at most 25% from its bucket bounds
+struct HistogramSnapshot
+{
+	static constexpr int SUB_BITS = 2;
+	static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+	static constexpr int BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+	static int BucketIndex(uint64_t value)
+	{
+		if (value < SUB_BUCKETS)
+		{
+			return static_cast<int>(value);
+		}
+		const int msb = 63 - __builtin_clzll(value);
+		const int sub = static_cast<int>((value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+		return (msb - SUB_BITS + 1) * SUB_BUCKETS + sub;
+	}
+
+	static uint64_t BucketUpperBound(int index)
+	{
+		if (index < SUB_BUCKETS)
+		{
+			return static_cast<uint64_t>(index);
+		}
+		const int msb = index / SUB_BUCKETS + SUB_BITS - 1;
+		const uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+		const uint64_t lower = (uint64_t{ 1 } << msb) | (sub << (msb - SUB_BITS));
+		return lower + ((uint64_t{ 1 } << (msb - SUB_BITS)) - 1);
+	}
+
+	// Upper bound of the bucket holding the q-th quantile, q in [0, 1]
+	uint64_t Percentile(double q) const
+	{
+		if (total == 0)
+		{
+			return 0;
+		}
+		const uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKET_COUNT; ++i)
+		{
+			seen += counts[i];
+			if (seen >= rank)
+			{
+				return BucketUpperBound(i);
+			}
+		}
+		return BucketUpperBound(BUCKET_COUNT - 1);
+	}
+
+	double Mean() const
+	{
+		return total == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(total);
+	}
+
+	void Merge(const HistogramSnapshot& other)
+	{
+		for (int i = 0; i < BUCKET_COUNT; ++i)
+		{
+			counts[i] += other.counts[i];
+		}
+		total += other.total;
+		sum += other.sum;
+	}
+
+	std::array<uint64_t, BUCKET_COUNT> counts{};
+	uint64_t total = 0;
+	uint64_t sum = 0;
+};
+
+// Lock-free recording side of HistogramSnapshot, safe for any number of writers
+class LogHistogram
+{
+public:
+	void Record(uint64_t value)
+	{
+		buckets_[HistogramSnapshot::BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		total_.fetch_add(1, std::memory_order_relaxed);
+		sum_.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	void AddTo(HistogramSnapshot& snapshot) const
+	{
+		for (int i = 0; i < HistogramSnapshot::BUCKET_COUNT; ++i)
+		{
+			snapshot.counts[i] += buckets_[i].load(std::memory_order_relaxed);
+		}
+		snapshot.total += total_.load(std::memory_order_relaxed);
+		snapshot.sum += sum_.load(std::memory_order_relaxed);
+	}
+
+	void Reset()
+	{
+		for (auto& bucket : buckets_)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		total_.store(0, std::memory_order_relaxed);
+		sum_.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKET_COUNT> buckets_{};
+	std::atomic<uint64_t> total_{ 0 };
+	std::atomic<uint64_t> sum_{ 0 };
+};
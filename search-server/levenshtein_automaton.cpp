@@ -0,0 +1,38 @@
+#include <algorithm>
+#include <numeric>
+
+#include "levenshtein_automaton.h"
+
+LevenshteinAutomaton::LevenshteinAutomaton(std::string_view word, int max_distance)
+	: word_(word), max_distance_(max_distance)
+{
+}
+
+LevenshteinAutomaton::State LevenshteinAutomaton::Start() const
+{
+	State state(word_.size() + 1);
+	std::iota(state.begin(), state.end(), 0);
+	return state;
+}
+
+LevenshteinAutomaton::State LevenshteinAutomaton::Step(const State& state, char c) const
+{
+	State next(state.size());
+	next[0] = state[0] + 1;
+	for (size_t i = 1; i < state.size(); ++i)
+	{
+		const int substitution = state[i - 1] + (word_[i - 1] == c ? 0 : 1);
+		next[i] = std::min({ substitution, state[i] + 1, next[i - 1] + 1 });
+	}
+	// Values above max_distance_ + 1 carry no extra information
+	for (int& distance : next)
+	{
+		distance = std::min(distance, max_distance_ + 1);
+	}
+	return next;
+}
+
+bool LevenshteinAutomaton::CanMatch(const State& state) const
+{
+	return *std::min_element(state.begin(), state.end()) <= max_distance_;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Accepts the strings within max_distance edits (insertion, deletion,
+// substitution) of a word. A state is the row of the edit distance matrix
+// for the characters consumed so far, so walking a sorted dictionary can
+// share the states of common prefixes and drop whole subtrees as soon as
+// CanMatch turns false.
+class LevenshteinAutomaton
+{
+public:
+	using State = std::vector<int>;
+
+	LevenshteinAutomaton(std::string_view word, int max_distance);
+
+	State Start() const;
+
+	State Step(const State& state, char c) const;
+
+	bool IsMatch(const State& state) const
+	{
+		return state.back() <= max_distance_;
+	}
+
+	// False once no continuation of the consumed string can be accepted
+	bool CanMatch(const State& state) const;
+
+	int Distance(const State& state) const
+	{
+		return state.back();
+	}
+
+private:
+	const std::string word_;
+	const int max_distance_;
+};
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "lz_codec.h"
+#include "varint.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	const size_t MIN_MATCH = 4;
+	const int HASH_BITS = 14;
+	const size_t MAX_OFFSET = 1 << 16;
+
+	uint32_t ReadUint32(const char* data)
+	{
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint32_t HashOf(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+}
+
+std::string LzCompress(std::string_view raw)
+{
+	std::string out;
+	out.reserve(raw.size() / 2 + 16);
+	AppendVarint(out, raw.size());
+
+	// Positions are stored + 1 so that zero means an empty slot
+	std::vector<uint32_t> table(size_t{ 1 } << HASH_BITS, 0);
+	size_t literal_start = 0;
+	size_t pos = 0;
+
+	while (pos + MIN_MATCH <= raw.size())
+	{
+		const uint32_t sequence = ReadUint32(raw.data() + pos);
+		uint32_t& slot = table[HashOf(sequence)];
+		const size_t candidate = slot;
+		slot = static_cast<uint32_t>(pos + 1);
+
+		if (candidate == 0 || pos + 1 - candidate > MAX_OFFSET
+			|| ReadUint32(raw.data() + candidate - 1) != sequence)
+		{
+			++pos;
+			continue;
+		}
+
+		const size_t match_start = candidate - 1;
+		size_t length = MIN_MATCH;
+		while (pos + length < raw.size() && raw[match_start + length] == raw[pos + length])
+		{
+			++length;
+		}
+
+		AppendVarint(out, pos - literal_start);
+		out.append(raw.data() + literal_start, pos - literal_start);
+		AppendVarint(out, pos - match_start);
+		AppendVarint(out, length - MIN_MATCH);
+
+		pos += length;
+		literal_start = pos;
+	}
+
+	if (literal_start < raw.size() || raw.empty())
+	{
+		AppendVarint(out, raw.size() - literal_start);
+		out.append(raw.data() + literal_start, raw.size() - literal_start);
+	}
+	return out;
+}
+
+std::string LzDecompress(std::string_view compressed)
+{
+	uint64_t raw_size = 0;
+	if (!ReadVarint(compressed, raw_size))
+	{
+		throw std::invalid_argument("Compressed block is truncated"s);
+	}
+
+	std::string out;
+	out.reserve(std::min<uint64_t>(raw_size, compressed.size() * 256));
+	while (out.size() < raw_size)
+	{
+		uint64_t literal_count = 0;
+		if (!ReadVarint(compressed, literal_count) || literal_count > compressed.size()
+			|| out.size() + literal_count > raw_size)
+		{
+			throw std::invalid_argument("Compressed block is corrupted"s);
+		}
+		out.append(compressed.data(), literal_count);
+		compressed.remove_prefix(literal_count);
+		if (out.size() == raw_size)
+		{
+			break;
+		}
+
+		uint64_t offset = 0;
+		uint64_t length = 0;
+		if (!ReadVarint(compressed, offset) || !ReadVarint(compressed, length)
+			|| offset == 0 || offset > out.size() || out.size() + length + MIN_MATCH > raw_size)
+		{
+			throw std::invalid_argument("Compressed block is corrupted"s);
+		}
+		// The match may overlap the bytes it produces, so copy one byte at a time
+		size_t from = out.size() - offset;
+		for (uint64_t i = 0; i < length + MIN_MATCH; ++i)
+		{
+			const char c = out[from++];
+			out.push_back(c);
+		}
+	}
+	return out;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Small byte-oriented LZ77 codec in the spirit of LZ4: greedy matching
+// through a hash of the next four bytes, no entropy coding. It trades ratio
+// for speed, which is what an on-demand document store needs.
+//
+// Format: varint raw size, then sequences of
+//   varint literal count, literals, varint match offset, varint match length - 4
+// The last sequence stops after its literals, once the raw size is reached.
+
+std::string LzCompress(std::string_view raw);
+
+// Throws std::invalid_argument on corrupted input
+std::string LzDecompress(std::string_view compressed);
@@ -5,11 +5,14 @@
 
 #include "process_queries.h"
 #include "search_server.h"
+#include "test_example_functions.h"
 
 using namespace std;
   
 int main() 
 {
+    TestSearchServer();
+
     SearchServer search_server("and with"s);
     int id = 0;
     for (
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "managed_index.h"
+
+using namespace std::string_literals;
+
+RebuildPacer::RebuildPacer(double duty_cycle, Clock::duration slice, const std::atomic<bool>& cancelled) :
+	duty_cycle_(duty_cycle), slice_(slice), cancelled_(cancelled)
+{
+	if (!(duty_cycle_ > 0.0 && duty_cycle_ <= 1.0))
+	{
+		throw std::invalid_argument("Duty cycle must be in (0, 1]"s);
+	}
+}
+
+bool RebuildPacer::Pace()
+{
+	if (cancelled_.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+
+	const Clock::time_point now = Clock::now();
+	const Clock::duration busy = now - slice_start_;
+	if (busy < slice_ || duty_cycle_ >= 1.0)
+	{
+		return true;
+	}
+
+	// Rest in short steps to notice a cancellation quickly
+	const auto rest = std::chrono::duration_cast<Clock::duration>(busy * (1.0 / duty_cycle_ - 1.0));
+	const Clock::time_point rest_end = now + rest;
+	while (Clock::now() < rest_end)
+	{
+		if (cancelled_.load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::min<Clock::duration>(rest_end - Clock::now(), std::chrono::milliseconds(10)));
+	}
+	slice_start_ = Clock::now();
+	return true;
+}
+
+ManagedIndex::ManagedIndex(std::unique_ptr<SearchServer> search_server, RebuildOptions options) :
+	options_(options)
+{
+	if (!search_server)
+	{
+		throw std::invalid_argument("Search server is null"s);
+	}
+	retire_thread_ = std::thread(&ManagedIndex::RunRetire, std::ref(*retire_queue_));
+	search_server_ = MakeServed(std::move(search_server));
+}
+
+ManagedIndex::~ManagedIndex()
+{
+	cancelled_.store(true, std::memory_order_relaxed);
+	if (rebuild_thread_.joinable())
+	{
+		rebuild_thread_.join();
+	}
+
+	// Queued before the stop, so the retire thread destroys it unless a query still holds it
+	search_server_.reset();
+	{
+		std::lock_guard g(retire_queue_->mutex);
+		retire_queue_->stopping = true;
+	}
+	retire_queue_->cv.notify_one();
+	retire_thread_.join();
+}
+
+std::shared_ptr<const SearchServer> ManagedIndex::Get() const
+{
+	return std::atomic_load_explicit(&search_server_, std::memory_order_acquire);
+}
+
+void ManagedIndex::StartRebuild(Builder builder)
+{
+	std::lock_guard g(rebuild_mutex_);
+	if (rebuilding_.load(std::memory_order_acquire))
+	{
+		throw std::logic_error("Index rebuild is already running"s);
+	}
+	if (rebuild_thread_.joinable())
+	{
+		rebuild_thread_.join();
+	}
+
+	published_ = false;
+	rebuild_error_ = nullptr;
+	uint64_t generation;
+	{
+		std::lock_guard publish_guard(publish_mutex_);
+		generation = generation_;
+		cancelled_.store(false, std::memory_order_relaxed);
+	}
+	rebuilding_.store(true, std::memory_order_release);
+	rebuild_thread_ = std::thread(&ManagedIndex::RunRebuild, this, std::move(builder), generation);
+}
+
+void ManagedIndex::StartRebuild(const std::string& stop_words_text, IndexOptions options)
+{
+	const std::shared_ptr<const SearchServer> source = Get();
+	StartRebuild(
+		[source, stop_words_text, options](RebuildPacer& pacer) -> std::unique_ptr<SearchServer>
+		{
+			auto search_server = std::make_unique<SearchServer>(stop_words_text, options);
+			for (const int document_id : *source)
+			{
+				if (!pacer.Pace())
+				{
+					return nullptr;
+				}
+				search_server->AddDocument(document_id, source->GetDocumentContent(document_id),
+					source->GetDocumentStatus(document_id), { source->GetDocumentRating(document_id) });
+			}
+			return search_server;
+		});
+}
+
+bool ManagedIndex::WaitForRebuild()
+{
+	std::lock_guard g(rebuild_mutex_);
+	if (rebuild_thread_.joinable())
+	{
+		rebuild_thread_.join();
+	}
+	if (rebuild_error_)
+	{
+		std::rethrow_exception(std::exchange(rebuild_error_, nullptr));
+	}
+	return published_;
+}
+
+void ManagedIndex::Replace(std::unique_ptr<SearchServer> search_server)
+{
+	if (!search_server)
+	{
+		throw std::invalid_argument("Search server is null"s);
+	}
+	std::lock_guard g(publish_mutex_);
+	cancelled_.store(true, std::memory_order_relaxed);
+	Publish(std::move(search_server));
+}
+
+void ManagedIndex::RunRebuild(Builder builder, uint64_t generation)
+{
+	try
+	{
+		RebuildPacer pacer(options_.duty_cycle, options_.slice, cancelled_);
+		std::unique_ptr<SearchServer> search_server = builder(pacer);
+		// The builder may hold the current index itself
+		builder = nullptr;
+		std::lock_guard g(publish_mutex_);
+		if (search_server && !cancelled_.load(std::memory_order_relaxed) && generation_ == generation)
+		{
+			// Queries that started before the swap keep the old index until they drop it
+			Publish(std::move(search_server));
+			published_ = true;
+		}
+	}
+	catch (...)
+	{
+		rebuild_error_ = std::current_exception();
+	}
+	rebuilding_.store(false, std::memory_order_release);
+}
+
+void ManagedIndex::RunRetire(RetireQueue& queue)
+{
+	std::unique_lock lock(queue.mutex);
+	while (true)
+	{
+		queue.cv.wait(lock, [&queue] { return queue.stopping || !queue.retired.empty(); });
+		if (queue.retired.empty())
+		{
+			return;
+		}
+		const SearchServer* retired = queue.retired.front();
+		queue.retired.pop_front();
+		lock.unlock();
+		delete retired;
+		lock.lock();
+	}
+}
+
+std::shared_ptr<const SearchServer> ManagedIndex::MakeServed(std::unique_ptr<SearchServer> search_server) const
+{
+	return std::shared_ptr<const SearchServer>(search_server.release(),
+		[queue = retire_queue_](const SearchServer* retired)
+		{
+			{
+				std::lock_guard g(queue->mutex);
+				if (!queue->stopping)
+				{
+					queue->retired.push_back(retired);
+					queue->cv.notify_one();
+					return;
+				}
+			}
+			delete retired;
+		});
+}
+
+void ManagedIndex::Publish(std::unique_ptr<SearchServer> search_server)
+{
+	++generation_;
+	std::atomic_store_explicit(&search_server_, MakeServed(std::move(search_server)), std::memory_order_release);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "search_server.h"
+
+// Paces a background rebuild so that it takes at most a duty_cycle share of
+// one core: after every slice of work it sleeps long enough to keep the
+// share. A builder calls Pace() between documents and stops when it
+// returns false, which means the rebuild was cancelled.
+class RebuildPacer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	RebuildPacer(double duty_cycle, Clock::duration slice, const std::atomic<bool>& cancelled);
+
+	bool Pace();
+
+private:
+	const double duty_cycle_;
+	const Clock::duration slice_;
+	const std::atomic<bool>& cancelled_;
+	Clock::time_point slice_start_ = Clock::now();
+};
+
+struct RebuildOptions
+{
+	// Share of a core the rebuild may take, in (0, 1]. 1 means no throttling
+	double duty_cycle = 0.25;
+	// Work done between two rests; short slices keep query latency even
+	std::chrono::steady_clock::duration slice = std::chrono::milliseconds(2);
+};
+
+// Serves a SearchServer that can be replaced without downtime. Queries take a
+// handle with Get() and keep the index they started with alive until they
+// drop it. A rebuild runs on a background thread while the current index
+// keeps serving, then the new index is published with an atomic store. An
+// index whose last handle is dropped is destroyed on a thread the ManagedIndex
+// owns, so neither a query nor the rebuild waits for the teardown; a handle
+// outliving the ManagedIndex destroys its index where it is dropped.
+//
+// The served index is read-only: documents are added only through rebuilds.
+class ManagedIndex
+{
+public:
+	using Builder = std::function<std::unique_ptr<SearchServer>(RebuildPacer& pacer)>;
+
+	explicit ManagedIndex(std::unique_ptr<SearchServer> search_server, RebuildOptions options = {});
+
+	ManagedIndex(const ManagedIndex&) = delete;
+	ManagedIndex& operator=(const ManagedIndex&) = delete;
+
+	// Cancels a running rebuild and waits for the retired indexes to be destroyed
+	~ManagedIndex();
+
+	std::shared_ptr<const SearchServer> Get() const;
+
+	// Starts building a replacement. The builder may return null to give up.
+	// Throws std::logic_error if a rebuild is already running
+	void StartRebuild(Builder builder);
+
+	// Rebuilds the current documents with other stop words and index options.
+	// The current index must store document texts
+	void StartRebuild(const std::string& stop_words_text, IndexOptions options = {});
+
+	bool IsRebuilding() const { return rebuilding_.load(std::memory_order_acquire); }
+
+	// Waits for the running rebuild, true if it published a new index.
+	// Rethrows an exception thrown by the builder
+	bool WaitForRebuild();
+
+	// Publishes an index built elsewhere. A running rebuild is cancelled and
+	// never publishes over it
+	void Replace(std::unique_ptr<SearchServer> search_server);
+
+private:
+	// Indexes waiting for the retire thread. Shared with the deleters of the
+	// handles, which may outlive the ManagedIndex
+	struct RetireQueue
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<const SearchServer*> retired;
+		bool stopping = false;
+	};
+
+	const RebuildOptions options_;
+	const std::shared_ptr<RetireQueue> retire_queue_ = std::make_shared<RetireQueue>();
+	std::thread retire_thread_;
+
+	// Every publication bumps the generation; a rebuild publishes only if
+	// nothing was published since it started
+	std::mutex publish_mutex_;
+	uint64_t generation_ = 0;
+	std::shared_ptr<const SearchServer> search_server_;
+
+	std::mutex rebuild_mutex_;
+	std::thread rebuild_thread_;
+	std::atomic<bool> rebuilding_{ false };
+	std::atomic<bool> cancelled_{ false };
+	bool published_ = false;
+	std::exception_ptr rebuild_error_;
+
+	void RunRebuild(Builder builder, uint64_t generation);
+
+	static void RunRetire(RetireQueue& queue);
+
+	// Takes ownership with a deleter that hands the index to the retire thread
+	std::shared_ptr<const SearchServer> MakeServed(std::unique_ptr<SearchServer> search_server) const;
+
+	// Under publish_mutex_
+	void Publish(std::unique_ptr<SearchServer> search_server);
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "histogram.h"
+
+// Heap usage estimates for SearchServer::GetMemoryStats. Nothing is measured:
+// sizes are derived from element counts and the layout of the standard
+// containers, so a report costs one pass over the words and the documents.
+//
+// The allocator model is glibc malloc on 64-bit: every chunk carries an
+// 8-byte header and is rounded up to 16 bytes, with a minimum of 32.
+
+// Bytes malloc spends on a request of the given size
+inline size_t AllocatedBytes(size_t requested)
+{
+	const size_t chunk = (requested + sizeof(size_t) + 15) & ~size_t{ 15 };
+	return chunk < 32 ? 32 : chunk;
+}
+
+// Node of std::map / std::set: color, parent, left and right, then the value
+template<typename Value>
+constexpr size_t TreeNodeBytes()
+{
+	return 4 * sizeof(void*) + sizeof(Value);
+}
+
+// Heap buffer of a string, zero while the text fits the small string buffer
+inline size_t StringHeapBytes(const std::string& text)
+{
+	return text.capacity() > 15 ? text.capacity() + 1 : 0;
+}
+
+struct ContainerMemory
+{
+	std::string_view name;
+	// Nodes of the container and of the containers nested in it
+	uint64_t elements = 0;
+	// Bytes requested from the allocator
+	uint64_t payload_bytes = 0;
+	// Chunk headers and rounding on top of payload_bytes
+	uint64_t overhead_bytes = 0;
+
+	// Zero bytes stand for no allocation
+	void AddAllocations(size_t bytes, uint64_t count = 1)
+	{
+		if (bytes == 0)
+		{
+			return;
+		}
+		payload_bytes += bytes * count;
+		overhead_bytes += (AllocatedBytes(bytes) - bytes) * count;
+	}
+
+	template<typename Value>
+	void AddNodes(uint64_t count)
+	{
+		elements += count;
+		AddAllocations(TreeNodeBytes<Value>(), count);
+	}
+
+	uint64_t Bytes() const { return payload_bytes + overhead_bytes; }
+};
+
+struct MemoryStats
+{
+	std::vector<ContainerMemory> containers;
+	// Number of documents per indexed word
+	HistogramSnapshot posting_lengths;
+
+	uint64_t TotalBytes() const
+	{
+		uint64_t bytes = 0;
+		for (const ContainerMemory& container : containers)
+		{
+			bytes += container.Bytes();
+		}
+		return bytes;
+	}
+};
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <execution>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mutation_log.h"
+#include "varint.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+	// Sequence and type
+	const size_t MIN_BODY_SIZE = sizeof(uint64_t) + 1;
+
+	// CRC-32 (IEEE 802.3) sliced by 4 bytes
+	const std::array<std::array<uint32_t, 256>, 4> CRC_TABLES = []
+	{
+		std::array<std::array<uint32_t, 256>, 4> tables{};
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+			}
+			tables[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			for (size_t t = 1; t < tables.size(); ++t)
+			{
+				tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xFF];
+			}
+		}
+		return tables;
+	}();
+
+	uint32_t Crc32(std::string_view data)
+	{
+		uint32_t crc = 0xFFFFFFFFu;
+		const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+		size_t size = data.size();
+		while (size >= 4)
+		{
+			uint32_t word;
+			std::memcpy(&word, bytes, sizeof(word));
+			crc ^= word;
+			crc = CRC_TABLES[3][crc & 0xFF] ^ CRC_TABLES[2][(crc >> 8) & 0xFF]
+				^ CRC_TABLES[1][(crc >> 16) & 0xFF] ^ CRC_TABLES[0][crc >> 24];
+			bytes += 4;
+			size -= 4;
+		}
+		while (size-- > 0)
+		{
+			crc = (crc >> 8) ^ CRC_TABLES[0][(crc ^ *bytes++) & 0xFF];
+		}
+		return ~crc;
+	}
+
+	template <typename T>
+	void AppendFixed(std::string& out, T value)
+	{
+		out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	template <typename T>
+	T ReadFixed(const char* data)
+	{
+		T value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint64_t ZigZag(int value)
+	{
+		return (static_cast<uint64_t>(static_cast<int64_t>(value)) << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63);
+	}
+
+	int UnZigZag(uint64_t value)
+	{
+		return static_cast<int>(static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1));
+	}
+
+	void AppendRatings(std::string& out, const std::vector<int>& ratings)
+	{
+		AppendVarint(out, ratings.size());
+		for (const int rating : ratings)
+		{
+			AppendVarint(out, ZigZag(rating));
+		}
+	}
+
+	bool ReadRatings(std::string_view& body, std::vector<int>& ratings)
+	{
+		uint64_t count = 0;
+		if (!ReadVarint(body, count) || count > body.size())
+		{
+			return false;
+		}
+		ratings.resize(count);
+		for (int& rating : ratings)
+		{
+			uint64_t value = 0;
+			if (!ReadVarint(body, value))
+			{
+				return false;
+			}
+			rating = UnZigZag(value);
+		}
+		return true;
+	}
+
+	bool ReadStatus(std::string_view& body, DocumentStatus& status)
+	{
+		if (body.empty() || static_cast<unsigned char>(body.front()) > static_cast<unsigned char>(DocumentStatus::REMOVED))
+		{
+			return false;
+		}
+		status = static_cast<DocumentStatus>(body.front());
+		body.remove_prefix(1);
+		return true;
+	}
+
+	bool DecodeBody(std::string_view body, LoggedMutation& record)
+	{
+		record.sequence = ReadFixed<uint64_t>(body.data());
+		Mutation& mutation = record.mutation;
+		mutation.type = static_cast<MutationType>(body[sizeof(uint64_t)]);
+		body.remove_prefix(MIN_BODY_SIZE);
+
+		uint64_t document_id = 0;
+		if (!ReadVarint(body, document_id) || document_id > static_cast<uint64_t>(INT32_MAX))
+		{
+			return false;
+		}
+		mutation.document_id = static_cast<int>(document_id);
+
+		switch (mutation.type)
+		{
+		case MutationType::ADD_DOCUMENT:
+		{
+			uint64_t text_size = 0;
+			if (!ReadStatus(body, mutation.status) || !ReadRatings(body, mutation.ratings)
+				|| !ReadVarint(body, text_size) || text_size != body.size())
+			{
+				return false;
+			}
+			mutation.text = std::string(body);
+			return true;
+		}
+		case MutationType::REMOVE_DOCUMENT:
+			return body.empty();
+		case MutationType::UPDATE_STATUS:
+			return ReadStatus(body, mutation.status) && body.empty();
+		case MutationType::UPDATE_RATINGS:
+			return ReadRatings(body, mutation.ratings) && body.empty();
+		default:
+			return false;
+		}
+	}
+
+	std::system_error LastError(const std::string& what)
+	{
+		return std::system_error(errno, std::generic_category(), what);
+	}
+}
+
+void AppendMutationRecord(std::string& out, uint64_t sequence, const Mutation& mutation)
+{
+	const size_t header_at = out.size();
+	out.resize(header_at + RECORD_HEADER_SIZE);
+	const size_t body_at = out.size();
+
+	AppendFixed(out, sequence);
+	out.push_back(static_cast<char>(mutation.type));
+	AppendVarint(out, static_cast<uint64_t>(mutation.document_id));
+	switch (mutation.type)
+	{
+	case MutationType::ADD_DOCUMENT:
+		out.push_back(static_cast<char>(mutation.status));
+		AppendRatings(out, mutation.ratings);
+		AppendVarint(out, mutation.text.size());
+		out.append(mutation.text);
+		break;
+	case MutationType::UPDATE_STATUS:
+		out.push_back(static_cast<char>(mutation.status));
+		break;
+	case MutationType::UPDATE_RATINGS:
+		AppendRatings(out, mutation.ratings);
+		break;
+	default:
+		break;
+	}
+
+	const std::string_view body(out.data() + body_at, out.size() - body_at);
+	const uint32_t body_size = static_cast<uint32_t>(body.size());
+	const uint32_t crc = Crc32(body);
+	std::memcpy(out.data() + header_at, &body_size, sizeof(body_size));
+	std::memcpy(out.data() + header_at + sizeof(body_size), &crc, sizeof(crc));
+}
+
+std::vector<LoggedMutation> ReadMutationRecords(std::string_view data, size_t& valid_bytes)
+{
+	// Only the sizes chain the records together, everything else is independent
+	std::vector<std::string_view> records;
+	size_t offset = 0;
+	while (data.size() - offset >= RECORD_HEADER_SIZE)
+	{
+		const uint32_t body_size = ReadFixed<uint32_t>(data.data() + offset);
+		if (body_size < MIN_BODY_SIZE || body_size > data.size() - offset - RECORD_HEADER_SIZE)
+		{
+			break;
+		}
+		records.push_back(data.substr(offset, RECORD_HEADER_SIZE + body_size));
+		offset += RECORD_HEADER_SIZE + body_size;
+	}
+
+	std::vector<LoggedMutation> result(records.size());
+	std::vector<char> valid(records.size());
+	std::vector<size_t> indexes(records.size());
+	std::iota(indexes.begin(), indexes.end(), 0);
+	std::for_each(
+		std::execution::par,
+		indexes.begin(), indexes.end(),
+		[&records, &result, &valid](size_t i)
+		{
+			const std::string_view record = records[i];
+			const std::string_view body = record.substr(RECORD_HEADER_SIZE);
+			valid[i] = ReadFixed<uint32_t>(record.data() + sizeof(uint32_t)) == Crc32(body)
+				&& DecodeBody(body, result[i]);
+		});
+
+	const size_t valid_count = static_cast<size_t>(std::find(valid.begin(), valid.end(), 0) - valid.begin());
+	result.resize(valid_count);
+	valid_bytes = 0;
+	for (size_t i = 0; i < valid_count; ++i)
+	{
+		valid_bytes += records[i].size();
+	}
+	return result;
+}
+
+MutationLog::MutationLog(const std::string& path, uint64_t last_sequence, MutationLogOptions options) :
+	options_(options), path_(path), last_sequence_(last_sequence), durable_sequence_(last_sequence)
+{
+	fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd_ < 0)
+	{
+		throw LastError("Can't open mutation log "s + path);
+	}
+	flusher_ = std::thread(&MutationLog::RunFlusher, this);
+}
+
+MutationLog::~MutationLog()
+{
+	{
+		std::lock_guard g(mutex_);
+		stopping_ = true;
+	}
+	flush_cv_.notify_one();
+	flusher_.join();
+	::close(fd_);
+}
+
+std::vector<LoggedMutation> MutationLog::Recover(const std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		return {};
+	}
+	const std::string data{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+	in.close();
+
+	size_t valid_bytes = 0;
+	std::vector<LoggedMutation> records = ReadMutationRecords(data, valid_bytes);
+	if (valid_bytes < data.size() && ::truncate(path.c_str(), static_cast<off_t>(valid_bytes)) != 0)
+	{
+		throw LastError("Can't truncate mutation log "s + path);
+	}
+	return records;
+}
+
+uint64_t MutationLog::Append(const Mutation& mutation)
+{
+	std::unique_lock lock(mutex_);
+	ThrowIfFailed();
+	const uint64_t sequence = ++last_sequence_;
+	if (pending_.empty())
+	{
+		first_pending_time_ = Clock::now();
+	}
+	AppendMutationRecord(pending_, sequence, mutation);
+	const bool batch_full = pending_.size() >= options_.max_batch_bytes;
+	lock.unlock();
+
+	// The flusher wakes up on its own when the batch gets old enough
+	if (batch_full)
+	{
+		flush_cv_.notify_one();
+	}
+	return sequence;
+}
+
+void MutationLog::WaitDurable(uint64_t sequence)
+{
+	std::unique_lock lock(mutex_);
+	++sync_waiters_;
+	flush_cv_.notify_one();
+	durable_cv_.wait(lock, [this, sequence] { return durable_sequence_ >= sequence || error_; });
+	--sync_waiters_;
+	ThrowIfFailed();
+}
+
+uint64_t MutationLog::GetLastSequence() const
+{
+	std::lock_guard g(mutex_);
+	return last_sequence_;
+}
+
+void MutationLog::Truncate()
+{
+	Flush();
+	std::lock_guard g(mutex_);
+	if (::ftruncate(fd_, 0) != 0 || (options_.fsync && ::fdatasync(fd_) != 0))
+	{
+		throw LastError("Can't truncate mutation log "s + path_);
+	}
+}
+
+void MutationLog::RunFlusher()
+{
+	std::unique_lock lock(mutex_);
+	while (true)
+	{
+		if (pending_.empty())
+		{
+			if (stopping_)
+			{
+				break;
+			}
+			flush_cv_.wait(lock, [this] { return !pending_.empty() || stopping_; });
+			continue;
+		}
+
+		const Clock::time_point deadline = first_pending_time_ + options_.sync_interval;
+		const bool ready = stopping_ || sync_waiters_ > 0 || pending_.size() >= options_.max_batch_bytes
+			|| Clock::now() >= deadline;
+		if (!ready)
+		{
+			flush_cv_.wait_until(lock, deadline);
+			continue;
+		}
+
+		std::string batch;
+		batch.swap(pending_);
+		const uint64_t batch_sequence = last_sequence_;
+		lock.unlock();
+
+		bool ok = true;
+		for (size_t written = 0; ok && written < batch.size();)
+		{
+			const ssize_t result = ::write(fd_, batch.data() + written, batch.size() - written);
+			if (result < 0 && errno != EINTR)
+			{
+				ok = false;
+			}
+			written += result > 0 ? static_cast<size_t>(result) : 0;
+		}
+		ok = ok && (!options_.fsync || ::fdatasync(fd_) == 0);
+		const std::exception_ptr error = ok ? nullptr
+			: std::make_exception_ptr(LastError("Can't write mutation log "s + path_));
+
+		lock.lock();
+		if (ok)
+		{
+			durable_sequence_ = batch_sequence;
+		}
+		else
+		{
+			error_ = error;
+		}
+		durable_cv_.notify_all();
+	}
+}
+
+void MutationLog::ThrowIfFailed()
+{
+	if (error_)
+	{
+		std::rethrow_exception(error_);
+	}
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+
+// Append-only log of index mutations. Every record is
+//   u32 body size, u32 CRC-32 of the body, body
+//   body: u64 sequence, u8 type, varint document id, type-specific fields
+// with fixed-size fields in host byte order. Records are numbered by a
+// sequence that keeps growing across truncations, so a snapshot can tell
+// which records it already contains.
+//
+// Append only copies the record into a memory batch. A flusher thread writes
+// the batch with one write() and one fdatasync(): when a caller waits for
+// durability, when the batch reaches max_batch_bytes or sync_interval after
+// its first record. Records appended during a sync join the next batch,
+// which is how concurrent writers share syncs (group commit).
+
+enum class MutationType : uint8_t
+{
+	ADD_DOCUMENT = 1,
+	REMOVE_DOCUMENT = 2,
+	UPDATE_STATUS = 3,
+	UPDATE_RATINGS = 4,
+};
+
+struct Mutation
+{
+	MutationType type = MutationType::ADD_DOCUMENT;
+	int document_id = 0;
+	// ADD_DOCUMENT and UPDATE_STATUS
+	DocumentStatus status = DocumentStatus::ACTUAL;
+	// ADD_DOCUMENT and UPDATE_RATINGS
+	std::vector<int> ratings;
+	// ADD_DOCUMENT
+	std::string text;
+};
+
+struct LoggedMutation
+{
+	uint64_t sequence;
+	Mutation mutation;
+};
+
+struct MutationLogOptions
+{
+	// Longest time a record stays in memory when nobody waits for it
+	std::chrono::steady_clock::duration sync_interval = std::chrono::milliseconds(5);
+	// A batch this large is written at once
+	size_t max_batch_bytes = 1 << 20;
+	// false only writes the batches and leaves them to the page cache
+	bool fsync = true;
+};
+
+// Record framing shared by the log and the snapshots
+void AppendMutationRecord(std::string& out, uint64_t sequence, const Mutation& mutation);
+
+// Decodes every complete record with a valid checksum. Checksums and bodies
+// are decoded in parallel; decoding stops at the first bad record and
+// valid_bytes tells where it starts
+std::vector<LoggedMutation> ReadMutationRecords(std::string_view data, size_t& valid_bytes);
+
+class MutationLog
+{
+public:
+	// Appends to the log at path, creating it if needed. Existing records
+	// must be read with Recover first; new ones are numbered after last_sequence
+	MutationLog(const std::string& path, uint64_t last_sequence, MutationLogOptions options = {});
+
+	MutationLog(const MutationLog&) = delete;
+	MutationLog& operator=(const MutationLog&) = delete;
+
+	// Writes and syncs everything appended
+	~MutationLog();
+
+	// Reads the records of the log at path and cuts off a torn or corrupted
+	// tail left by a crash. A missing file has no records
+	static std::vector<LoggedMutation> Recover(const std::string& path);
+
+	// Returns the sequence of the record. Throws std::runtime_error if the
+	// log could not be written since the last call
+	uint64_t Append(const Mutation& mutation);
+
+	// Blocks until the record with this sequence and all before it are synced
+	void WaitDurable(uint64_t sequence);
+
+	void Flush() { WaitDurable(GetLastSequence()); }
+
+	uint64_t GetLastSequence() const;
+
+	// Drops every record, for example once a snapshot holds them all.
+	// Appends must not run concurrently
+	void Truncate();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	const MutationLogOptions options_;
+	const std::string path_;
+	int fd_ = -1;
+
+	mutable std::mutex mutex_;
+	std::condition_variable flush_cv_;
+	std::condition_variable durable_cv_;
+	std::string pending_;
+	Clock::time_point first_pending_time_;
+	uint64_t last_sequence_;
+	uint64_t durable_sequence_;
+	size_t sync_waiters_ = 0;
+	bool stopping_ = false;
+	std::exception_ptr error_;
+	std::thread flusher_;
+
+	void RunFlusher();
+
+	// Needs mutex_ held
+	void ThrowIfFailed();
+};
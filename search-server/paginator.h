@@ -44,40 +44,96 @@ std::ostream &operator<<(std::ostream &out, const IteratorRange<Iterator> &range
 	return out;
 }
 
+// Pages are not stored: every page range is computed when it is requested,
+// in O(1) for random access iterators
 template <typename Iterator>
 class Paginator
 {
 public:
-	Paginator(Iterator begin, Iterator end, size_t page_size)
+	class PageIterator
 	{
-		for (size_t left = distance(begin, end); left > 0;)
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = IteratorRange<Iterator>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = value_type;
+
+		PageIterator(Iterator page_begin, Iterator end, size_t page_size)
+			: page_begin_(page_begin), end_(end), page_size_(page_size)
+		{
+		}
+
+		IteratorRange<Iterator> operator*() const
+		{
+			return { page_begin_, PageEnd() };
+		}
+
+		PageIterator& operator++()
+		{
+			page_begin_ = PageEnd();
+			return *this;
+		}
+
+		PageIterator operator++(int)
+		{
+			PageIterator previous = *this;
+			++*this;
+			return previous;
+		}
+
+		bool operator==(const PageIterator& other) const
 		{
-			const size_t current_page_size = std::min(page_size, left);
-			const Iterator current_page_end = std::next(begin, current_page_size);
-			pages_.push_back({begin, current_page_end});
+			return page_begin_ == other.page_begin_;
+		}
 
-			left -= current_page_size;
-			begin = current_page_end;
+		bool operator!=(const PageIterator& other) const
+		{
+			return !(*this == other);
 		}
+
+	private:
+		Iterator page_begin_, end_;
+		size_t page_size_;
+
+		Iterator PageEnd() const
+		{
+			const size_t left = std::distance(page_begin_, end_);
+			return std::next(page_begin_, std::min(page_size_, left));
+		}
+	};
+
+	Paginator(Iterator begin, Iterator end, size_t page_size)
+		: begin_(begin), end_(end), page_size_(page_size), size_(std::distance(begin, end))
+	{
 	}
 
-	auto begin() const
+	PageIterator begin() const
 	{
-		return pages_.begin();
+		return { begin_, end_, page_size_ };
 	}
 
-	auto end() const
+	PageIterator end() const
 	{
-		return pages_.end();
+		return { end_, end_, page_size_ };
 	}
 
 	size_t size() const
 	{
-		return pages_.size();
+		return page_size_ == 0 ? 0 : (size_ + page_size_ - 1) / page_size_;
+	}
+
+	IteratorRange<Iterator> GetPage(size_t index) const
+	{
+		const size_t first = std::min(index * page_size_, size_);
+		const size_t last = std::min(first + page_size_, size_);
+		return { std::next(begin_, first), std::next(begin_, last) };
 	}
 
 private:
-	std::vector<IteratorRange<Iterator>> pages_;
+	Iterator begin_, end_;
+	size_t page_size_;
+	size_t size_;
 };
 
 template <typename Container>
@@ -85,4 +141,4 @@ auto Paginate(const Container &c, size_t page_size)
 {
 	const auto pages = Paginator(begin(c), end(c), page_size);
 	return pages;
-}
\ No newline at end of file
+}
@@ -0,0 +1,358 @@
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <system_error>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	struct EventConfig
+	{
+		uint32_t type;
+		uint64_t config;
+	};
+
+	constexpr uint64_t LLC_READ_MISSES = PERF_COUNT_HW_CACHE_LL
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+	// In PerfEvent order
+	constexpr std::array<EventConfig, PERF_EVENT_COUNT> EVENT_CONFIGS = { {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, LLC_READ_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+		{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+	} };
+
+	int OpenEvent(const EventConfig& event, int group_fd)
+	{
+		perf_event_attr attr{};
+		attr.size = sizeof(attr);
+		attr.type = event.type;
+		attr.config = event.config;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		// User space only, as allowed by the default perf_event_paranoid
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+	}
+
+	// Counts of one thread, written by that thread only
+	struct AtomicCounts
+	{
+		std::atomic<uint64_t> calls{ 0 };
+		std::array<std::atomic<uint64_t>, PERF_EVENT_COUNT> values{};
+
+		void Add(const PerfCounts& counts)
+		{
+			calls.store(calls.load(std::memory_order_relaxed) + counts.calls, std::memory_order_relaxed);
+			for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+			{
+				values[i].store(values[i].load(std::memory_order_relaxed) + counts.values[i], std::memory_order_relaxed);
+			}
+		}
+
+		void AddTo(PerfCounts& counts) const
+		{
+			counts.calls += calls.load(std::memory_order_relaxed);
+			for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+			{
+				counts.values[i] += values[i].load(std::memory_order_relaxed);
+			}
+		}
+
+		void Reset()
+		{
+			calls.store(0, std::memory_order_relaxed);
+			for (auto& value : values)
+			{
+				value.store(0, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	struct ThreadPerf
+	{
+		PerfCounterGroup group;
+		std::array<std::array<AtomicCounts, QUERY_CLASS_COUNT>, QUERY_STAGE_COUNT> totals;
+
+		// The query running on the thread; its stages wait in pending
+		// until the QUERY stage ends and the class is known
+		int query_depth = 0;
+		QueryClass query_class = QueryClass::UNCLASSIFIED;
+		std::array<PerfCounts, QUERY_STAGE_COUNT> pending;
+	};
+
+	struct Registry
+	{
+		std::mutex registry_mutex;
+		std::deque<ThreadPerf> threads;
+	};
+
+	// Never destroyed, like the registry of QueryMetrics
+	Registry& GetRegistry()
+	{
+		static Registry* registry = new Registry;
+		return *registry;
+	}
+
+	ThreadPerf& LocalPerf()
+	{
+		thread_local ThreadPerf* local = []
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard g(registry.registry_mutex);
+			return &registry.threads.emplace_back();
+		}();
+		return *local;
+	}
+}
+
+std::string_view ToString(PerfEvent event)
+{
+	switch (event)
+	{
+	case PerfEvent::CYCLES:
+		return "cycles";
+	case PerfEvent::INSTRUCTIONS:
+		return "instructions";
+	case PerfEvent::LLC_MISSES:
+		return "llc_misses";
+	case PerfEvent::BRANCH_MISSES:
+		return "branch_misses";
+	case PerfEvent::TASK_CLOCK:
+		return "task_clock_ns";
+	case PerfEvent::CONTEXT_SWITCHES:
+		return "context_switches";
+	default:
+		return "unknown";
+	}
+}
+
+std::string_view ToString(QueryClass query_class)
+{
+	switch (query_class)
+	{
+	case QueryClass::SINGLE_WORD:
+		return "single_word";
+	case QueryClass::MULTI_WORD:
+		return "multi_word";
+	case QueryClass::MINUS_WORDS:
+		return "minus_words";
+	case QueryClass::CONJUNCTIVE:
+		return "conjunctive";
+	case QueryClass::UNCLASSIFIED:
+		return "unclassified";
+	default:
+		return "unknown";
+	}
+}
+
+PerfCounts& PerfCounts::operator+=(const PerfCounts& other)
+{
+	calls += other.calls;
+	for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+	{
+		values[i] += other.values[i];
+	}
+	return *this;
+}
+
+PerfCounts PerfProfile::Get(QueryStage stage, QueryClass query_class) const
+{
+	for (const PerfProfileEntry& entry : entries)
+	{
+		if (entry.stage == stage && entry.query_class == query_class)
+		{
+			return entry.counts;
+		}
+	}
+	return {};
+}
+
+PerfCounts PerfProfile::Get(QueryStage stage) const
+{
+	PerfCounts result;
+	for (const PerfProfileEntry& entry : entries)
+	{
+		if (entry.stage == stage)
+		{
+			result += entry.counts;
+		}
+	}
+	return result;
+}
+
+PerfCounterGroup::PerfCounterGroup()
+{
+	slots_.fill(-1);
+	// An event the machine lacks is skipped, the others still count
+	for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+	{
+		const int fd = OpenEvent(EVENT_CONFIGS[i], fds_.empty() ? -1 : fds_.front());
+		if (fd < 0)
+		{
+			error_ += (error_.empty() ? ""s : "; "s) + std::string(ToString(static_cast<PerfEvent>(i))) + ": "s
+				+ std::generic_category().message(errno);
+			continue;
+		}
+		slots_[i] = static_cast<int>(fds_.size());
+		fds_.push_back(fd);
+	}
+}
+
+PerfCounterGroup::~PerfCounterGroup()
+{
+	for (const int fd : fds_)
+	{
+		::close(fd);
+	}
+}
+
+PerfCounterGroup::Reading PerfCounterGroup::Read() const
+{
+	Reading reading;
+	if (fds_.empty())
+	{
+		return reading;
+	}
+
+	// nr, time_enabled, time_running, then a value per open event
+	std::array<uint64_t, 3 + PERF_EVENT_COUNT> buffer{};
+	if (::read(fds_.front(), buffer.data(), sizeof(buffer)) < static_cast<ssize_t>((3 + fds_.size()) * sizeof(uint64_t)))
+	{
+		return reading;
+	}
+	reading.time_enabled = buffer[1];
+	reading.time_running = buffer[2];
+	for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+	{
+		if (slots_[i] >= 0)
+		{
+			reading.values[i] = buffer[3 + slots_[i]];
+		}
+	}
+	return reading;
+}
+
+std::array<uint64_t, PERF_EVENT_COUNT> PerfCounterGroup::Difference(const Reading& start, const Reading& end)
+{
+	const uint64_t enabled = end.time_enabled - start.time_enabled;
+	const uint64_t running = end.time_running - start.time_running;
+	std::array<uint64_t, PERF_EVENT_COUNT> result{};
+	for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+	{
+		const uint64_t count = end.values[i] - start.values[i];
+		result[i] = running == 0 || running == enabled ? count
+			: static_cast<uint64_t>(static_cast<double>(count) * enabled / running);
+	}
+	return result;
+}
+
+void PerfProfiler::SetQueryClass(QueryClass query_class)
+{
+	LocalPerf().query_class = query_class;
+}
+
+PerfProfile PerfProfiler::Collect()
+{
+	// Opens the counters of the calling thread if it never profiled,
+	// so that availability is known before the first query
+	LocalPerf();
+
+	PerfProfile result;
+	std::array<std::array<PerfCounts, QUERY_CLASS_COUNT>, QUERY_STAGE_COUNT> counts;
+
+	Registry& registry = GetRegistry();
+	std::lock_guard g(registry.registry_mutex);
+	for (const ThreadPerf& thread : registry.threads)
+	{
+		for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+		{
+			result.available[i] = result.available[i] || thread.group.IsOpen(static_cast<PerfEvent>(i));
+		}
+		if (result.unavailable_reason.empty())
+		{
+			result.unavailable_reason = thread.group.GetError();
+		}
+		for (int stage = 0; stage < QUERY_STAGE_COUNT; ++stage)
+		{
+			for (int query_class = 0; query_class < QUERY_CLASS_COUNT; ++query_class)
+			{
+				thread.totals[stage][query_class].AddTo(counts[stage][query_class]);
+			}
+		}
+	}
+
+	for (int stage = 0; stage < QUERY_STAGE_COUNT; ++stage)
+	{
+		for (int query_class = 0; query_class < QUERY_CLASS_COUNT; ++query_class)
+		{
+			if (counts[stage][query_class].calls > 0)
+			{
+				result.entries.push_back({ static_cast<QueryStage>(stage), static_cast<QueryClass>(query_class),
+					counts[stage][query_class] });
+			}
+		}
+	}
+	return result;
+}
+
+void PerfProfiler::Reset()
+{
+	Registry& registry = GetRegistry();
+	std::lock_guard g(registry.registry_mutex);
+	for (ThreadPerf& thread : registry.threads)
+	{
+		for (auto& stage : thread.totals)
+		{
+			for (AtomicCounts& counts : stage)
+			{
+				counts.Reset();
+			}
+		}
+	}
+}
+
+PerfScope::PerfScope(QueryStage stage) : stage_(stage)
+{
+	ThreadPerf& local = LocalPerf();
+	if (stage_ == QueryStage::QUERY && local.query_depth++ == 0)
+	{
+		local.query_class = QueryClass::UNCLASSIFIED;
+	}
+	start_ = local.group.Read();
+}
+
+PerfScope::~PerfScope()
+{
+	ThreadPerf& local = LocalPerf();
+	PerfCounts counts;
+	counts.calls = 1;
+	counts.values = PerfCounterGroup::Difference(start_, local.group.Read());
+
+	if (local.query_depth == 0)
+	{
+		local.totals[static_cast<int>(stage_)][static_cast<int>(QueryClass::UNCLASSIFIED)].Add(counts);
+		return;
+	}
+	local.pending[static_cast<int>(stage_)] += counts;
+	if (stage_ == QueryStage::QUERY && --local.query_depth == 0)
+	{
+		for (int stage = 0; stage < QUERY_STAGE_COUNT; ++stage)
+		{
+			local.totals[stage][static_cast<int>(local.query_class)].Add(local.pending[stage]);
+			local.pending[stage] = {};
+		}
+	}
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "query_metrics.h"
+
+// CPU counters of the query and ingestion stages, read with Linux
+// perf_event_open. Build with -DSEARCH_SERVER_PERF to enable them: every
+// QUERY_STAGE_TIMER then also counts the events of its own thread.
+// Counters the kernel or the machine does not provide (virtual machines,
+// perf_event_paranoid, seccomp) read zero and are reported as unavailable;
+// profiling never fails a query.
+//
+// A stage is attributed to the class of the query it runs in. Stages outside
+// of any query, ingestion and the scoring done on pool threads by parallel
+// searches, are UNCLASSIFIED: profile with std::execution::seq to keep
+// the whole cost of a query with its class.
+
+enum class PerfEvent
+{
+	CYCLES,
+	INSTRUCTIONS,
+	LLC_MISSES,
+	BRANCH_MISSES,
+	// Software events, available wherever perf_event_open is.
+	// Nanoseconds on the CPU: the rest of the wall time was spent waiting
+	TASK_CLOCK,
+	CONTEXT_SWITCHES,
+	COUNT_,
+};
+
+enum class QueryClass
+{
+	SINGLE_WORD,
+	MULTI_WORD,
+	// Plus-words and minus-words
+	MINUS_WORDS,
+	// Required words or phrases
+	CONJUNCTIVE,
+	UNCLASSIFIED,
+	COUNT_,
+};
+
+constexpr int PERF_EVENT_COUNT = static_cast<int>(PerfEvent::COUNT_);
+constexpr int QUERY_CLASS_COUNT = static_cast<int>(QueryClass::COUNT_);
+
+std::string_view ToString(PerfEvent event);
+std::string_view ToString(QueryClass query_class);
+
+struct PerfCounts
+{
+	uint64_t calls = 0;
+	std::array<uint64_t, PERF_EVENT_COUNT> values{};
+
+	uint64_t Get(PerfEvent event) const { return values[static_cast<int>(event)]; }
+
+	double PerCall(PerfEvent event) const
+	{
+		return calls == 0 ? 0.0 : static_cast<double>(Get(event)) / calls;
+	}
+
+	double InstructionsPerCycle() const
+	{
+		const uint64_t cycles = Get(PerfEvent::CYCLES);
+		return cycles == 0 ? 0.0 : static_cast<double>(Get(PerfEvent::INSTRUCTIONS)) / cycles;
+	}
+
+	// Events per thousand instructions, the usual scale of cache and branch misses
+	double PerKiloInstruction(PerfEvent event) const
+	{
+		const uint64_t instructions = Get(PerfEvent::INSTRUCTIONS);
+		return instructions == 0 ? 0.0 : 1000.0 * Get(event) / instructions;
+	}
+
+	PerfCounts& operator+=(const PerfCounts& other);
+};
+
+struct PerfProfileEntry
+{
+	QueryStage stage;
+	QueryClass query_class;
+	PerfCounts counts;
+};
+
+struct PerfProfile
+{
+	std::array<bool, PERF_EVENT_COUNT> available{};
+	// Why events could not be opened, empty when all of them were
+	std::string unavailable_reason;
+	// Stage and class pairs that ran at least once
+	std::vector<PerfProfileEntry> entries;
+
+	bool IsAvailable(PerfEvent event) const { return available[static_cast<int>(event)]; }
+
+	// Zero counts for a pair that never ran
+	PerfCounts Get(QueryStage stage, QueryClass query_class) const;
+	// The stage over all query classes
+	PerfCounts Get(QueryStage stage) const;
+};
+
+// The events of the calling thread, opened as one group so that a reading
+// takes one read() and all the values cover the same interval
+class PerfCounterGroup
+{
+public:
+	struct Reading
+	{
+		std::array<uint64_t, PERF_EVENT_COUNT> values{};
+		uint64_t time_enabled = 0;
+		uint64_t time_running = 0;
+	};
+
+	PerfCounterGroup();
+	~PerfCounterGroup();
+
+	PerfCounterGroup(const PerfCounterGroup&) = delete;
+	PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+	bool IsOpen() const { return !fds_.empty(); }
+	bool IsOpen(PerfEvent event) const { return slots_[static_cast<int>(event)] >= 0; }
+	const std::string& GetError() const { return error_; }
+
+	Reading Read() const;
+
+	// Counts between two readings. When more events are open than the PMU has
+	// counters the kernel time-slices the group, the counts are then scaled
+	// up by the share of the interval the group was counting
+	static std::array<uint64_t, PERF_EVENT_COUNT> Difference(const Reading& start, const Reading& end);
+
+private:
+	// Group leader first
+	std::vector<int> fds_;
+	// Position of every event in a group read, -1 if it is not open
+	std::array<int, PERF_EVENT_COUNT> slots_;
+	std::string error_;
+};
+
+class PerfProfiler
+{
+public:
+	// Attributes the query running on this thread
+	static void SetQueryClass(QueryClass query_class);
+
+	// Merges the counts of every thread that has ever profiled a stage
+	static PerfProfile Collect();
+	static void Reset();
+};
+
+class PerfScope
+{
+public:
+	explicit PerfScope(QueryStage stage);
+	~PerfScope();
+
+	PerfScope(const PerfScope&) = delete;
+	PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+	const QueryStage stage_;
+	PerfCounterGroup::Reading start_;
+};
@@ -6,17 +6,23 @@
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries)
 {
-	std::vector<std::vector<Document>> process_queries(queries.size());
+	// Batch queries share the traversal of their common words
+	return search_server.FindTopDocumentsBatch(std::execution::par, queries);
+}
+
+std::vector<SearchResult> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries,
+	const QueryBudget& budget)
+{
+	std::vector<SearchResult> process_queries(queries.size());
 
 	std::transform(
 		std::execution::par,
 		queries.begin(), queries.end(),
 		process_queries.begin(),
-		[&search_server](const auto& query)
-		{ return search_server.FindTopDocuments(query); });
+		[&search_server, &budget](const auto& query)
+		{ return search_server.FindTopDocuments(query, budget); });
 
 	return process_queries;
-
 }
 
 std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries)
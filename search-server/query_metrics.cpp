@@ -0,0 +1,197 @@
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+
+#include "query_metrics.h"
+
+namespace
+{
+	struct ThreadMetrics
+	{
+		std::array<LogHistogram, QUERY_STAGE_COUNT> stages;
+		std::array<std::atomic<uint64_t>, QUERY_COUNTER_COUNT> counters{};
+	};
+
+	// What the threads that have exited recorded
+	struct RetiredMetrics
+	{
+		std::array<HistogramSnapshot, QUERY_STAGE_COUNT> stages;
+		std::array<uint64_t, QUERY_COUNTER_COUNT> counters{};
+	};
+
+	struct Registry
+	{
+		std::mutex registry_mutex;
+		std::list<ThreadMetrics> threads;
+		RetiredMetrics retired;
+	};
+
+	// Never destroyed: pool threads may still record while static objects are torn down
+	Registry& GetRegistry()
+	{
+		static Registry* registry = new Registry;
+		return *registry;
+	}
+
+	// Registers the thread's metrics on its first record and on thread exit
+	// folds them into the retired totals, so the registry holds live threads only
+	class LocalMetricsEntry
+	{
+	public:
+		LocalMetricsEntry()
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard g(registry.registry_mutex);
+			entry_ = registry.threads.emplace(registry.threads.end());
+		}
+
+		LocalMetricsEntry(const LocalMetricsEntry&) = delete;
+		LocalMetricsEntry& operator=(const LocalMetricsEntry&) = delete;
+
+		~LocalMetricsEntry()
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard g(registry.registry_mutex);
+			for (int i = 0; i < QUERY_STAGE_COUNT; ++i)
+			{
+				entry_->stages[i].AddTo(registry.retired.stages[i]);
+			}
+			for (int i = 0; i < QUERY_COUNTER_COUNT; ++i)
+			{
+				registry.retired.counters[i] += entry_->counters[i].load(std::memory_order_relaxed);
+			}
+			registry.threads.erase(entry_);
+		}
+
+		ThreadMetrics& Get() { return *entry_; }
+
+	private:
+		std::list<ThreadMetrics>::iterator entry_;
+	};
+
+	thread_local bool metrics_paused = false;
+
+	ThreadMetrics& LocalMetrics()
+	{
+		thread_local LocalMetricsEntry local;
+		return local.Get();
+	}
+
+	// The hierarchy is two levels deep: QUERY is the root and the parent of
+	// itself, the ingestion stages are roots of their own
+	QueryStage ParentOf(QueryStage stage)
+	{
+		if (stage == QueryStage::ADD_DOCUMENT || stage == QueryStage::REMOVE_DOCUMENT)
+		{
+			return stage;
+		}
+		return QueryStage::QUERY;
+	}
+}
+
+std::string_view ToString(QueryStage stage)
+{
+	switch (stage)
+	{
+	case QueryStage::QUERY:
+		return "query";
+	case QueryStage::PARSE:
+		return "parse";
+	case QueryStage::POSTING_FETCH:
+		return "posting_fetch";
+	case QueryStage::SCORE:
+		return "score";
+	case QueryStage::MINUS_FILTER:
+		return "minus_filter";
+	case QueryStage::TOP_K_SORT:
+		return "top_k_sort";
+	case QueryStage::ADD_DOCUMENT:
+		return "add_document";
+	case QueryStage::REMOVE_DOCUMENT:
+		return "remove_document";
+	default:
+		return "unknown";
+	}
+}
+
+void QueryMetrics::RecordStage(QueryStage stage, uint64_t nanoseconds)
+{
+	if (metrics_paused)
+	{
+		return;
+	}
+	LocalMetrics().stages[static_cast<int>(stage)].Record(nanoseconds);
+}
+
+void QueryMetrics::AddCount(QueryCounter counter, uint64_t value)
+{
+	if (metrics_paused)
+	{
+		return;
+	}
+	// Only the owning thread adds, but Reset may store zero meanwhile: an add
+	// split into a load and a store would bring the old value back
+	LocalMetrics().counters[static_cast<int>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+QueryMetricsSnapshot QueryMetrics::Collect()
+{
+	QueryMetricsSnapshot result;
+	for (int i = 0; i < QUERY_STAGE_COUNT; ++i)
+	{
+		const auto stage = static_cast<QueryStage>(i);
+		result.stages.push_back({ stage, ParentOf(stage), {} });
+	}
+
+	Registry& registry = GetRegistry();
+	std::lock_guard g(registry.registry_mutex);
+	std::array<uint64_t, QUERY_COUNTER_COUNT> counters = registry.retired.counters;
+	for (int i = 0; i < QUERY_STAGE_COUNT; ++i)
+	{
+		result.stages[i].nanoseconds.Merge(registry.retired.stages[i]);
+	}
+	for (const ThreadMetrics& thread : registry.threads)
+	{
+		for (int i = 0; i < QUERY_STAGE_COUNT; ++i)
+		{
+			thread.stages[i].AddTo(result.stages[i].nanoseconds);
+		}
+		for (int i = 0; i < QUERY_COUNTER_COUNT; ++i)
+		{
+			counters[i] += thread.counters[i].load(std::memory_order_relaxed);
+		}
+	}
+	result.postings_scanned = counters[static_cast<int>(QueryCounter::POSTINGS_SCANNED)];
+	result.documents_matched = counters[static_cast<int>(QueryCounter::DOCUMENTS_MATCHED)];
+	result.partial_results = counters[static_cast<int>(QueryCounter::PARTIAL_RESULTS)];
+	return result;
+}
+
+void QueryMetrics::Reset()
+{
+	Registry& registry = GetRegistry();
+	std::lock_guard g(registry.registry_mutex);
+	registry.retired = {};
+	for (ThreadMetrics& thread : registry.threads)
+	{
+		for (auto& stage : thread.stages)
+		{
+			stage.Reset();
+		}
+		for (auto& counter : thread.counters)
+		{
+			counter.store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+QueryMetrics::Pause::Pause() : was_paused_(metrics_paused)
+{
+	metrics_paused = true;
+}
+
+QueryMetrics::Pause::~Pause()
+{
+	metrics_paused = was_paused_;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "histogram.h"
+
+// Query instrumentation. Build with -DSEARCH_SERVER_METRICS to enable it,
+// otherwise QUERY_STAGE_TIMER and QUERY_COUNTER_ADD expand to nothing.
+// Every thread records into its own histograms, QueryMetrics::Collect merges them.
+// -DSEARCH_SERVER_PERF adds CPU counters to the stages, see perf_counters.h.
+
+// QUERY covers a whole FindTopDocuments call, the other query stages are
+// nested in it. ADD_DOCUMENT and REMOVE_DOCUMENT time ingestion
+enum class QueryStage
+{
+	QUERY,
+	PARSE,
+	POSTING_FETCH,
+	SCORE,
+	MINUS_FILTER,
+	TOP_K_SORT,
+	ADD_DOCUMENT,
+	REMOVE_DOCUMENT,
+	COUNT_,
+};
+
+enum class QueryCounter
+{
+	POSTINGS_SCANNED,
+	DOCUMENTS_MATCHED,
+	// Queries cut short by their QueryBudget
+	PARTIAL_RESULTS,
+	COUNT_,
+};
+
+constexpr int QUERY_STAGE_COUNT = static_cast<int>(QueryStage::COUNT_);
+constexpr int QUERY_COUNTER_COUNT = static_cast<int>(QueryCounter::COUNT_);
+
+std::string_view ToString(QueryStage stage);
+
+struct StageMetrics
+{
+	QueryStage stage;
+	QueryStage parent;
+	HistogramSnapshot nanoseconds;
+
+	uint64_t Percentile(double q) const { return nanoseconds.Percentile(q); }
+};
+
+struct QueryMetricsSnapshot
+{
+	std::vector<StageMetrics> stages;
+	uint64_t postings_scanned = 0;
+	uint64_t documents_matched = 0;
+	uint64_t partial_results = 0;
+
+	const StageMetrics& Get(QueryStage stage) const { return stages[static_cast<int>(stage)]; }
+};
+
+class QueryMetrics
+{
+public:
+	static void RecordStage(QueryStage stage, uint64_t nanoseconds);
+	static void AddCount(QueryCounter counter, uint64_t value);
+
+	// Merges the histograms of every thread that has ever recorded anything,
+	// the threads that have exited included
+	static QueryMetricsSnapshot Collect();
+	static void Reset();
+
+	// Drops what the current thread records while it is alive, for work
+	// that is not the application's own, such as calibration
+	class Pause
+	{
+	public:
+		Pause();
+		~Pause();
+
+		Pause(const Pause&) = delete;
+		Pause& operator=(const Pause&) = delete;
+
+	private:
+		const bool was_paused_;
+	};
+};
+
+class StageTimer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit StageTimer(QueryStage stage) : stage_(stage) {}
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+	~StageTimer()
+	{
+		const auto duration = Clock::now() - start_time_;
+		QueryMetrics::RecordStage(stage_,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	}
+
+private:
+	const QueryStage stage_;
+	const Clock::time_point start_time_ = Clock::now();
+};
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+#ifdef SEARCH_SERVER_METRICS
+#define QUERY_STAGE_CLOCK(stage) StageTimer METRICS_CONCAT(stageTimer, __LINE__)(stage)
+#define QUERY_COUNTER_ADD(counter, value) QueryMetrics::AddCount((counter), (value))
+#else
+#define QUERY_STAGE_CLOCK(stage) ((void)0)
+#define QUERY_COUNTER_ADD(counter, value) ((void)0)
+#endif
+
+// PerfScope and PerfProfiler come from perf_counters.h
+#ifdef SEARCH_SERVER_PERF
+#define QUERY_STAGE_PERF(stage) PerfScope METRICS_CONCAT(perfScope, __LINE__)(stage)
+#define QUERY_CLASSIFY(query_class) PerfProfiler::SetQueryClass(query_class)
+#else
+#define QUERY_STAGE_PERF(stage) ((void)0)
+#define QUERY_CLASSIFY(query_class) ((void)0)
+#endif
+
+#define QUERY_STAGE_TIMER(stage) QUERY_STAGE_CLOCK(stage); QUERY_STAGE_PERF(stage)
@@ -0,0 +1,129 @@
+#include "query_pipeline.h"
+
+#if __cplusplus >= 202002L
+
+#include <algorithm>
+#include <iterator>
+
+bool QueryScheduler::RunReady()
+{
+	if (ready_.empty())
+	{
+		return false;
+	}
+	while (!ready_.empty())
+	{
+		const std::coroutine_handle<> handle = ready_.front();
+		ready_.pop_front();
+		handle.resume();
+	}
+	return true;
+}
+
+void QueryPipeline::Run()
+{
+	// Fetches are served once every query has run as far as it can, so a
+	// round gathers the words of all the queries reaching that stage
+	while (scheduler_.RunReady() || ServeFetches())
+	{
+	}
+}
+
+std::vector<Document> QueryPipeline::FindTopDocuments(std::string_view raw_query, DocumentStatus status)
+{
+	Task<std::vector<Document>> task = Search(std::string(raw_query), status);
+	Start(task);
+	Run();
+	return task.TakeResult();
+}
+
+std::vector<std::vector<Document>> QueryPipeline::FindTopDocuments(const std::vector<std::string>& raw_queries,
+	DocumentStatus status)
+{
+	std::vector<Task<std::vector<Document>>> tasks;
+	tasks.reserve(raw_queries.size());
+	for (const std::string& raw_query : raw_queries)
+	{
+		tasks.push_back(Search(raw_query, status));
+		Start(tasks.back());
+	}
+	Run();
+
+	std::vector<std::vector<Document>> results;
+	results.reserve(tasks.size());
+	for (Task<std::vector<Document>>& task : tasks)
+	{
+		results.push_back(task.TakeResult());
+	}
+	return results;
+}
+
+Task<QueryPipeline::Query> QueryPipeline::Parse(std::string_view raw_query)
+{
+	QUERY_STAGE_TIMER(QueryStage::PARSE);
+	co_return search_server_.ParseQuery(raw_query, true);
+}
+
+Task<QueryPipeline::PostingFetch> QueryPipeline::FetchPostings(const Query& query)
+{
+	PostingFetch fetch;
+	fetch.plus_words = query.plus_words;
+	fetch.minus_words = query.minus_words;
+	co_await FetchAwaiter{ *this, fetch };
+	co_return fetch;
+}
+
+bool QueryPipeline::ServeFetches()
+{
+	if (pending_fetches_.empty())
+	{
+		return false;
+	}
+	QUERY_STAGE_TIMER(QueryStage::POSTING_FETCH);
+
+	std::vector<std::string_view> words;
+	for (const PostingFetch* fetch : pending_fetches_)
+	{
+		words.insert(words.end(), fetch->plus_words.begin(), fetch->plus_words.end());
+		words.insert(words.end(), fetch->minus_words.begin(), fetch->minus_words.end());
+	}
+	std::sort(words.begin(), words.end());
+	words.erase(std::unique(words.begin(), words.end()), words.end());
+
+	// Every distinct word of the round is looked up once
+	std::vector<const Postings*> postings(words.size(), nullptr);
+	for (size_t i = 0; i < words.size(); ++i)
+	{
+		const auto it = search_server_.word_to_document_freqs_.find(words[i]);
+		if (it != search_server_.word_to_document_freqs_.end())
+		{
+			postings[i] = &it->second;
+		}
+	}
+
+	auto find_postings = [&words, &postings](std::string_view word)
+	{
+		return postings[std::lower_bound(words.begin(), words.end(), word) - words.begin()];
+	};
+	for (PostingFetch* fetch : pending_fetches_)
+	{
+		std::transform(fetch->plus_words.begin(), fetch->plus_words.end(),
+			std::back_inserter(fetch->plus_postings), find_postings);
+		std::transform(fetch->minus_words.begin(), fetch->minus_words.end(),
+			std::back_inserter(fetch->minus_postings), find_postings);
+		scheduler_.Schedule(fetch->waiter);
+	}
+	pending_fetches_.clear();
+	return true;
+}
+
+Task<std::vector<Document>> QueryPipeline::SelectTop(std::vector<Document> documents)
+{
+	// Behind the queries still scoring, so the sorts of a round run together
+	co_await scheduler_.Yield();
+	QUERY_STAGE_TIMER(QueryStage::TOP_K_SORT);
+	SearchServer::SelectTopDocuments(std::execution::seq, documents, SearchAfter{}, MAX_RESULT_DOCUMENT_COUNT);
+	co_return documents;
+}
+
+#endif
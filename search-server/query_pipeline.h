@@ -0,0 +1,305 @@
+#pragma once
+
+// Coroutine execution of queries, built only as C++20:
+//   g++ -std=c++20 ... query_pipeline.cpp
+// The rest of the search server stays C++17.
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "search_server.h"
+
+// Lazy coroutine returning a T. It starts when awaited, or when a scheduler
+// runs it, and resumes its awaiter when it completes
+template <typename T>
+class Task
+{
+public:
+	struct promise_type
+	{
+		std::optional<T> value;
+		std::exception_ptr exception;
+		std::coroutine_handle<> continuation;
+
+		Task get_return_object()
+		{
+			return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		auto final_suspend() noexcept
+		{
+			struct FinalAwaiter
+			{
+				bool await_ready() noexcept { return false; }
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+				{
+					const std::coroutine_handle<> continuation = handle.promise().continuation;
+					return continuation ? continuation : std::noop_coroutine();
+				}
+
+				void await_resume() noexcept {}
+			};
+			return FinalAwaiter{};
+		}
+
+		void return_value(T result) { value.emplace(std::move(result)); }
+
+		void unhandled_exception() { exception = std::current_exception(); }
+	};
+
+	Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Destroy();
+			handle_ = std::exchange(other.handle_, {});
+		}
+		return *this;
+	}
+
+	~Task() { Destroy(); }
+
+	bool await_ready() const noexcept { return false; }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+	{
+		handle_.promise().continuation = awaiter;
+		return handle_;
+	}
+
+	T await_resume() { return TakeResult(); }
+
+	std::coroutine_handle<> GetHandle() const { return handle_; }
+
+	bool IsDone() const { return handle_ && handle_.done(); }
+
+	// Result of a completed task, rethrows its exception
+	T TakeResult()
+	{
+		promise_type& promise = handle_.promise();
+		if (promise.exception)
+		{
+			std::rethrow_exception(promise.exception);
+		}
+		return std::move(*promise.value);
+	}
+
+private:
+	std::coroutine_handle<promise_type> handle_;
+
+	explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+	void Destroy()
+	{
+		if (handle_)
+		{
+			handle_.destroy();
+		}
+	}
+};
+
+// Round-robin run queue of suspended coroutines, driven by one thread
+class QueryScheduler
+{
+public:
+	void Schedule(std::coroutine_handle<> handle) { ready_.push_back(handle); }
+
+	// Suspends the caller behind every coroutine that is ready to run
+	auto Yield()
+	{
+		struct YieldAwaiter
+		{
+			QueryScheduler& scheduler;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> handle) { scheduler.Schedule(handle); }
+			void await_resume() const noexcept {}
+		};
+		return YieldAwaiter{ *this };
+	}
+
+	// Resumes coroutines until none is ready, false if there was none
+	bool RunReady();
+
+private:
+	std::deque<std::coroutine_handle<>> ready_;
+};
+
+// Runs queries as coroutines of four stages: parsing, posting fetch, scoring
+// and top-K selection. A stage suspends its query instead of holding the
+// thread, so the queries in flight interleave: scoring yields every
+// SCORE_SLICE_POSTINGS postings, and the posting fetches of all the queries
+// that reach that stage in the same round are served together, looking every
+// distinct word up once. Rankings are the ones of
+// SearchServer::FindTopDocuments(std::execution::seq, ...).
+//
+// A pipeline and its queries belong to one thread, and the index must not
+// change while queries are in flight.
+class QueryPipeline
+{
+public:
+	static constexpr size_t SCORE_SLICE_POSTINGS = 4096;
+
+	explicit QueryPipeline(const SearchServer& search_server) : search_server_(search_server) {}
+
+	QueryPipeline(const QueryPipeline&) = delete;
+	QueryPipeline& operator=(const QueryPipeline&) = delete;
+
+	// The query as a task to be awaited by another coroutine, or started with
+	// Start() and completed by Run()
+	template <typename Scorer = TfIdfScorer>
+	Task<std::vector<Document>> Search(std::string raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+	template <typename T>
+	void Start(Task<T>& task) { scheduler_.Schedule(task.GetHandle()); }
+
+	// Runs the started tasks, and everything they await, to completion
+	void Run();
+
+	// Synchronous wrappers
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+	// All the queries in flight at once; throws the first failure after the
+	// others have completed
+	std::vector<std::vector<Document>> FindTopDocuments(const std::vector<std::string>& raw_queries,
+		DocumentStatus status = DocumentStatus::ACTUAL);
+
+private:
+	using Query = SearchServer::Query;
+	using Postings = std::map<int, double>;
+
+	// Posting lists of one query, null for the words that are not indexed
+	struct PostingFetch
+	{
+		std::vector<std::string_view> plus_words;
+		std::vector<std::string_view> minus_words;
+		std::vector<const Postings*> plus_postings;
+		std::vector<const Postings*> minus_postings;
+		std::coroutine_handle<> waiter;
+	};
+
+	struct FetchAwaiter
+	{
+		QueryPipeline& pipeline;
+		PostingFetch& fetch;
+
+		bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			fetch.waiter = handle;
+			pipeline.pending_fetches_.push_back(&fetch);
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	const SearchServer& search_server_;
+	QueryScheduler scheduler_;
+	std::vector<PostingFetch*> pending_fetches_;
+
+	Task<Query> Parse(std::string_view raw_query);
+
+	Task<PostingFetch> FetchPostings(const Query& query);
+
+	// Serves the waiting fetches, false if there was none
+	bool ServeFetches();
+
+	template <typename Scorer>
+	Task<std::map<int, double>> Score(const Query& query, const PostingFetch& fetch, DocumentStatus status);
+
+	Task<std::vector<Document>> SelectTop(std::vector<Document> documents);
+};
+
+template <typename Scorer>
+Task<std::vector<Document>> QueryPipeline::Search(std::string raw_query, DocumentStatus status)
+{
+	const Query query = co_await Parse(raw_query);
+
+	if (!query.required_words.empty())
+	{
+		// Conjunctive scoring walks the rarest list and probes the others, it has no fetch stage
+		co_await scheduler_.Yield();
+		co_return co_await SelectTop(search_server_.FindAllDocumentsConjunctive<Scorer>(query,
+			[status](int document_id, DocumentStatus document_status, int rating)
+			{
+				return document_status == status;
+			}));
+	}
+
+	const PostingFetch fetch = co_await FetchPostings(query);
+	const std::map<int, double> document_to_relevance = co_await Score<Scorer>(query, fetch, status);
+
+	std::vector<Document> matched_documents;
+	matched_documents.reserve(document_to_relevance.size());
+	for (const auto& [document_id, relevance] : document_to_relevance)
+	{
+		matched_documents.push_back({ document_id, relevance,
+			search_server_.documents_.at(document_id).rating.load(std::memory_order_relaxed) });
+	}
+	co_return co_await SelectTop(std::move(matched_documents));
+}
+
+template <typename Scorer>
+Task<std::map<int, double>> QueryPipeline::Score(const Query& query, const PostingFetch& fetch, DocumentStatus status)
+{
+	const Scorer scorer(search_server_.GetScoringStats());
+	auto document_predicate = [status](int document_id, DocumentStatus document_status, int rating)
+	{
+		return document_status == status;
+	};
+	std::map<int, double> document_to_relevance;
+	size_t slice_postings = 0;
+
+	for (size_t i = 0; i < fetch.plus_words.size(); ++i)
+	{
+		const Postings* postings = fetch.plus_postings[i];
+		if (postings == nullptr || postings->empty())
+		{
+			continue;
+		}
+		const double term_weight = search_server_.GetTermWeight(scorer, query, fetch.plus_words[i], *postings);
+		QUERY_COUNTER_ADD(QueryCounter::POSTINGS_SCANNED, postings->size());
+		for (auto first = postings->begin(); first != postings->end();)
+		{
+			auto last = first;
+			for (; last != postings->end() && slice_postings < SCORE_SLICE_POSTINGS; ++slice_postings)
+			{
+				++last;
+			}
+			search_server_.ScorePostings(scorer, term_weight, first, last, document_predicate,
+				[&document_to_relevance](int document_id, double score) { document_to_relevance[document_id] += score; });
+			first = last;
+			if (slice_postings == SCORE_SLICE_POSTINGS)
+			{
+				slice_postings = 0;
+				co_await scheduler_.Yield();
+			}
+		}
+	}
+
+	for (const Postings* postings : fetch.minus_postings)
+	{
+		if (postings != nullptr)
+		{
+			SearchServer::EraseDocuments(*postings, document_to_relevance);
+		}
+	}
+	QUERY_COUNTER_ADD(QueryCounter::DOCUMENTS_MATCHED, document_to_relevance.size());
+	co_return document_to_relevance;
+}
+
+#endif
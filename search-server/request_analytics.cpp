@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "request_analytics.h"
+
+RequestAnalytics::RequestAnalytics(const SearchServer& search_server,
+	Clock::duration bucket_width, size_t bucket_count) :
+	search_server_(search_server), bucket_width_(bucket_width), buckets_(bucket_count)
+{
+	if (bucket_width <= Clock::duration::zero() || bucket_count == 0)
+	{
+		throw std::invalid_argument("Invalid analytics window"s);
+	}
+}
+
+std::vector<Document> RequestAnalytics::AddFindRequest(const std::string& raw_query, DocumentStatus status)
+{
+	const auto start_time = Clock::now();
+	auto result = search_server_.FindTopDocuments(raw_query, status);
+	AddRequest(start_time, result.size());
+	return result;
+}
+
+std::vector<Document> RequestAnalytics::AddFindRequest(const std::string& raw_query)
+{
+	const auto start_time = Clock::now();
+	auto result = search_server_.FindTopDocuments(raw_query);
+	AddRequest(start_time, result.size());
+	return result;
+}
+
+RequestAnalytics::WindowStats RequestAnalytics::GetStats(Clock::duration window) const
+{
+	WindowStats stats;
+	stats.window = std::clamp(window, bucket_width_, bucket_width_ * static_cast<int64_t>(buckets_.size()));
+
+	const Clock::time_point now = Clock::now();
+	const int64_t bucket_count = static_cast<int64_t>(buckets_.size());
+	const int64_t last_slot = SlotOf(now);
+	const int64_t first_slot = std::max<int64_t>(0,
+		last_slot - (stats.window + bucket_width_ - Clock::duration(1)) / bucket_width_ + 1);
+
+	// The window is at most one lap, so every slot has a bucket of its own.
+	// Counters a new lap has taken over while they were read count as empty
+	for (int64_t slot = first_slot; slot <= last_slot; ++slot)
+	{
+		const Bucket& bucket = buckets_[slot % bucket_count];
+		const int64_t lap = slot / bucket_count;
+		stats.requests += bucket.requests.Load(lap);
+		stats.no_result_requests += bucket.no_result_requests.Load(lap);
+		for (int i = 0; i < RESULT_COUNT_SLOTS; ++i)
+		{
+			stats.result_counts[i] += bucket.result_counts[i].Load(lap);
+		}
+		for (int i = 0; i < HistogramSnapshot::BUCKET_COUNT; ++i)
+		{
+			const uint64_t count = bucket.latency_counts[i].Load(lap);
+			stats.latency_ns.counts[i] += count;
+			stats.latency_ns.total += count;
+		}
+		stats.latency_ns.sum += bucket.latency_sum_ns.Load(lap);
+	}
+
+	// The first window after construction is only as long as the time elapsed
+	const double seconds = std::chrono::duration<double>(std::min(stats.window, now - start_time_)).count();
+	stats.requests_per_second = seconds > 0.0 ? stats.requests / seconds : 0.0;
+	stats.no_result_rate = stats.requests == 0 ? 0.0 : static_cast<double>(stats.no_result_requests) / stats.requests;
+	return stats;
+}
+
+void RequestAnalytics::LapCounter::Add(int64_t lap, uint64_t value)
+{
+	const uint64_t tag = static_cast<uint64_t>(lap) & TAG_MASK;
+	uint64_t current = tagged_.load(std::memory_order_relaxed);
+	while (true)
+	{
+		const uint64_t current_tag = current >> VALUE_BITS;
+		const uint64_t writer_lag = (current_tag - tag) & TAG_MASK;
+		uint64_t next;
+		if (writer_lag == 0)
+		{
+			next = (tag << VALUE_BITS) | std::min(VALUE_MASK, (current & VALUE_MASK) + std::min(VALUE_MASK, value));
+		}
+		else if (writer_lag < MAX_WRITER_LAG)
+		{
+			return;
+		}
+		else
+		{
+			next = (tag << VALUE_BITS) | std::min(VALUE_MASK, value);
+		}
+		if (tagged_.compare_exchange_weak(current, next, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+}
+
+uint64_t RequestAnalytics::LapCounter::Load(int64_t lap) const
+{
+	const uint64_t current = tagged_.load(std::memory_order_relaxed);
+	return (current >> VALUE_BITS) == (static_cast<uint64_t>(lap) & TAG_MASK) ? current & VALUE_MASK : 0;
+}
+
+void RequestAnalytics::AddRequest(Clock::time_point start_time, size_t results_num)
+{
+	const auto end_time = Clock::now();
+	const int64_t slot = SlotOf(end_time);
+	const int64_t bucket_count = static_cast<int64_t>(buckets_.size());
+	Bucket& bucket = buckets_[slot % bucket_count];
+	const int64_t lap = slot / bucket_count;
+
+	bucket.requests.Add(lap, 1);
+	if (results_num == 0)
+	{
+		bucket.no_result_requests.Add(lap, 1);
+	}
+	bucket.result_counts[std::min<size_t>(results_num, RESULT_COUNT_SLOTS - 1)].Add(lap, 1);
+	const uint64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+	bucket.latency_counts[HistogramSnapshot::BucketIndex(latency_ns)].Add(lap, 1);
+	bucket.latency_sum_ns.Add(lap, latency_ns);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+#include "search_server.h"
+
+// Thread-safe counterpart of RequestQueue. Requests are accounted in wall-clock
+// buckets of a fixed ring, so statistics are available for any window up to
+// bucket_width * bucket_count. Recording a request takes no lock and never
+// waits: every counter carries the lap of the ring it counts for, so the first
+// request of a lap replaces the old value in the same compare-and-swap.
+class RequestAnalytics
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Result counts above MAX_RESULT_DOCUMENT_COUNT share the last slot
+	static constexpr int RESULT_COUNT_SLOTS = MAX_RESULT_DOCUMENT_COUNT + 1;
+
+	struct WindowStats
+	{
+		Clock::duration window;
+		uint64_t requests = 0;
+		uint64_t no_result_requests = 0;
+		double requests_per_second = 0.0;
+		double no_result_rate = 0.0;
+		std::array<uint64_t, RESULT_COUNT_SLOTS> result_counts{};
+		HistogramSnapshot latency_ns;
+	};
+
+	explicit RequestAnalytics(const SearchServer& search_server,
+		Clock::duration bucket_width = std::chrono::seconds(1), size_t bucket_count = 300);
+
+	template <typename DocumentPredicate>
+	std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
+
+	std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
+
+	std::vector<Document> AddFindRequest(const std::string& raw_query);
+
+	// Statistics of the requests finished during the last `window`
+	WindowStats GetStats(Clock::duration window) const;
+
+	uint64_t GetNoResultRequests(Clock::duration window) const { return GetStats(window).no_result_requests; }
+
+private:
+	// A count tagged with the lap, slot / bucket_count, it belongs to. The tag
+	// takes the high bits and wraps after 2^24 laps; the count saturates
+	class LapCounter
+	{
+	public:
+		static constexpr int TAG_BITS = 24;
+		static constexpr int VALUE_BITS = 64 - TAG_BITS;
+		static constexpr uint64_t VALUE_MASK = (uint64_t{ 1 } << VALUE_BITS) - 1;
+		static constexpr uint64_t TAG_MASK = (uint64_t{ 1 } << TAG_BITS) - 1;
+		// A writer this many laps behind the counter is stale, any further
+		// and the counter is the one left over from a wrapped-around lap
+		static constexpr uint64_t MAX_WRITER_LAG = 1024;
+
+		// Drops the value when the counter has already moved to a later lap
+		void Add(int64_t lap, uint64_t value);
+		uint64_t Load(int64_t lap) const;
+
+	private:
+		std::atomic<uint64_t> tagged_{ 0 };
+	};
+
+	struct Bucket
+	{
+		LapCounter requests;
+		LapCounter no_result_requests;
+		std::array<LapCounter, RESULT_COUNT_SLOTS> result_counts;
+		std::array<LapCounter, HistogramSnapshot::BUCKET_COUNT> latency_counts;
+		LapCounter latency_sum_ns;
+	};
+
+	const SearchServer& search_server_;
+	const Clock::time_point start_time_ = Clock::now();
+	const Clock::duration bucket_width_;
+	std::vector<Bucket> buckets_;
+
+	int64_t SlotOf(Clock::time_point time) const { return (time - start_time_) / bucket_width_; }
+
+	void AddRequest(Clock::time_point start_time, size_t results_num);
+};
+
+template<typename DocumentPredicate>
+inline std::vector<Document> RequestAnalytics::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate)
+{
+	const auto start_time = Clock::now();
+	auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
+	AddRequest(start_time, result.size());
+	return result;
+}
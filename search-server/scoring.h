@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+// Ranking functions for SearchServer::FindTopDocuments<Scorer>. A scorer is
+// created once per query and called directly from the scoring loops, so a
+// model is chosen at compile time and costs no virtual call per posting.
+//
+// A scorer provides
+//   explicit Scorer(const ScoringStats& stats);
+//   double TermWeight(size_t document_freq) const;  // once per query word
+//   double Score(double term_weight, double term_freq, int document_length) const;
+// term_freq is the share of the word among the non-stop words of the document,
+// document_length is the number of those words.
+
+struct ScoringStats
+{
+	double document_count;
+	double average_document_length;
+};
+
+class TfIdfScorer
+{
+public:
+	explicit TfIdfScorer(const ScoringStats& stats) : document_count_(stats.document_count) {}
+
+	double TermWeight(size_t document_freq) const
+	{
+		return std::log(document_count_ / document_freq);
+	}
+
+	double Score(double term_weight, double term_freq, int) const
+	{
+		return term_freq * term_weight;
+	}
+
+private:
+	double document_count_;
+};
+
+class Bm25Scorer
+{
+public:
+	static constexpr double K1 = 1.2;
+	static constexpr double B = 0.75;
+
+	// The length norm K1 * (1 - B + B * length / average_length) is split into
+	// two constants of the query, leaving one multiply-add per posting
+	explicit Bm25Scorer(const ScoringStats& stats)
+		: document_count_(stats.document_count)
+		, norm_base_(K1 * (1.0 - B))
+		, norm_per_word_(stats.average_document_length > 0.0 ? K1 * B / stats.average_document_length : 0.0)
+	{
+	}
+
+	double TermWeight(size_t document_freq) const
+	{
+		return std::log(1.0 + (document_count_ - document_freq + 0.5) / (document_freq + 0.5));
+	}
+
+	double Score(double term_weight, double term_freq, int document_length) const
+	{
+		const double count = term_freq * document_length;
+		return term_weight * count * (K1 + 1.0) / (count + norm_base_ + norm_per_word_ * document_length);
+	}
+
+private:
+	double document_count_;
+	double norm_base_;
+	double norm_per_word_;
+};
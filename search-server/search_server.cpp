@@ -1,14 +1,21 @@
-#include <execution> 
+#include <atomic>
+#include <chrono>
+#include <execution>
+#include <limits>
+#include <mutex>
+#include <thread>
 
+#include "levenshtein_automaton.h"
 #include "search_server.h"
 #include "string_processing.h"
+#include "varint.h"
 
 
-SearchServer::SearchServer(const std::string& stop_words_text) :
-	SearchServer(SplitIntoWords(static_cast<std::string_view>(stop_words_text))) {}
+SearchServer::SearchServer(const std::string& stop_words_text, IndexOptions options) :
+	SearchServer(SplitIntoWords(static_cast<std::string_view>(stop_words_text)), options) {}
 
-SearchServer::SearchServer(const std::string_view& stop_words_text) :
-	SearchServer::SearchServer(SplitIntoWords(stop_words_text)) {}
+SearchServer::SearchServer(const std::string_view& stop_words_text, IndexOptions options) :
+	SearchServer::SearchServer(SplitIntoWords(stop_words_text), options) {}
   
 void SearchServer::AddDocument(int document_id, const std::string_view& document,
 	DocumentStatus status, const std::vector<int>& ratings)
@@ -17,20 +24,43 @@ void SearchServer::AddDocument(int document_id, const std::string_view& document
 	{
 		throw std::invalid_argument("Invalid document_id"s);
 	}
+	QUERY_STAGE_TIMER(QueryStage::ADD_DOCUMENT);
 
 	const auto words = SplitIntoWordsNoStop(document);
 	const double inv_word_count = 1.0 / words.size();
 	auto& word_freqs = document_to_word_freqs_[document_id];
 
-	for (const std::string_view& word : words)
+	std::map<std::string_view, std::vector<uint32_t>> word_positions;
+	for (size_t position = 0; position < words.size(); ++position)
 	{
-		auto it = words_.insert(std::string(word));
+		auto it = words_.insert(std::string(words[position]));
 		std::string_view sw = *it.first;
 
 		word_to_document_freqs_[sw][document_id] += inv_word_count;
 		word_freqs[sw] += inv_word_count;
+		if (options_.store_positions)
+		{
+			word_positions[sw].push_back(static_cast<uint32_t>(position));
+		}
+	}
+
+	for (const auto& [word, positions] : word_positions)
+	{
+		std::string& encoded = word_to_document_positions_[word][document_id];
+		uint32_t previous = 0;
+		for (const uint32_t position : positions)
+		{
+			AppendVarint(encoded, position - previous);
+			previous = position;
+		}
+		position_heap_bytes_ += StringHeapBytes(encoded);
+	}
+	documents_.try_emplace(document_id, ComputeAverageRating(ratings), status, static_cast<int>(words.size()));
+	if (content_store_)
+	{
+		content_store_->Add(document_id, document);
 	}
-	documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, std::string(document) });
+	total_word_count_ += words.size();
 	document_ids_.insert(document_id);
 }
 
@@ -62,19 +92,189 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::execution::paral
 }
 
 
+std::vector<Document> SearchServer::FindTopDocuments(const AdaptiveExecutionPolicy&, std::string_view raw_query, DocumentStatus status) const
+{
+	return FindTopDocuments(
+		adaptive_execution,
+		raw_query,
+		[status](int document_id, DocumentStatus document_status, int rating)
+		{
+			return document_status == status;
+		});
+}
+
 const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
 {
 	static const std::map<std::string_view, double> empty;
-	static std::map<std::string_view, double> res;
-	if (document_to_word_freqs_.count(document_id))
+	const auto it = document_to_word_freqs_.find(document_id);
+	return it != document_to_word_freqs_.end() ? it->second : empty;
+}
+
+SearchServer::BudgetTracker::BudgetTracker(const QueryBudget& budget)
+	: max_postings_(budget.max_postings)
+	, has_deadline_(budget.time_limit > Clock::duration::zero())
+	, deadline_(Clock::now() + budget.time_limit)
+{
+}
+
+bool SearchServer::BudgetTracker::Charge(size_t postings)
+{
+	if (exhausted_)
 	{
-		for (const auto& item : document_to_word_freqs_.at(document_id))
+		return false;
+	}
+	if (max_postings_ > 0 && postings_charged_ + postings > max_postings_)
+	{
+		exhausted_ = true;
+		return false;
+	}
+	// The clock is read before taking the postings that complete an interval,
+	// so postings refused for the deadline are not charged either
+	if (postings_since_clock_ + postings >= BUDGET_CLOCK_INTERVAL)
+	{
+		if (!CheckDeadline())
 		{
-			res.insert(item);
-		};
-		return res;
+			return false;
+		}
+		postings_since_clock_ = 0;
+	}
+	else
+	{
+		postings_since_clock_ += postings;
+	}
+	postings_charged_ += postings;
+	return true;
+}
+
+bool SearchServer::BudgetTracker::CheckDeadline()
+{
+	if (has_deadline_ && !exhausted_ && Clock::now() >= deadline_)
+	{
+		exhausted_ = true;
 	}
-	return empty;
+	return !exhausted_;
+}
+
+MemoryStats SearchServer::GetMemoryStats() const
+{
+	MemoryStats stats;
+
+	const auto word_set_memory = [](std::string_view name, const std::set<std::string, std::less<>>& words)
+	{
+		ContainerMemory memory{ name };
+		memory.AddNodes<std::string>(words.size());
+		for (const std::string& word : words)
+		{
+			memory.AddAllocations(StringHeapBytes(word));
+		}
+		return memory;
+	};
+	stats.containers.push_back(word_set_memory("words", words_));
+	stats.containers.push_back(word_set_memory("stop_words", stop_words_));
+
+	ContainerMemory word_to_document_freqs{ "word_to_document_freqs" };
+	word_to_document_freqs.AddNodes<std::pair<const std::string_view, std::map<int, double>>>(word_to_document_freqs_.size());
+	for (const auto& [word, postings] : word_to_document_freqs_)
+	{
+		word_to_document_freqs.AddNodes<std::pair<const int, double>>(postings.size());
+		if (!postings.empty())
+		{
+			stats.posting_lengths.counts[HistogramSnapshot::BucketIndex(postings.size())] += 1;
+			stats.posting_lengths.total += 1;
+			stats.posting_lengths.sum += postings.size();
+		}
+	}
+	stats.containers.push_back(word_to_document_freqs);
+
+	ContainerMemory word_to_document_positions{ "word_to_document_positions" };
+	word_to_document_positions.AddNodes<std::pair<const std::string_view, std::map<int, std::string>>>(word_to_document_positions_.size());
+	for (const auto& [word, positions] : word_to_document_positions_)
+	{
+		word_to_document_positions.AddNodes<std::pair<const int, std::string>>(positions.size());
+	}
+	// The strings hold a few bytes each, their chunk overhead is not tracked
+	word_to_document_positions.payload_bytes += position_heap_bytes_;
+	stats.containers.push_back(word_to_document_positions);
+
+	ContainerMemory document_to_word_freqs{ "document_to_word_freqs" };
+	document_to_word_freqs.AddNodes<std::pair<const int, std::map<std::string_view, double>>>(document_to_word_freqs_.size());
+	for (const auto& [document_id, word_freqs] : document_to_word_freqs_)
+	{
+		document_to_word_freqs.AddNodes<std::pair<const std::string_view, double>>(word_freqs.size());
+	}
+	stats.containers.push_back(document_to_word_freqs);
+
+	ContainerMemory documents{ "documents" };
+	documents.AddNodes<std::pair<const int, DocumentData>>(documents_.size());
+	stats.containers.push_back(documents);
+
+	ContainerMemory document_ids{ "document_ids" };
+	document_ids.AddNodes<int>(document_ids_.size());
+	stats.containers.push_back(document_ids);
+
+	if (content_store_)
+	{
+		stats.containers.push_back(content_store_->GetMemoryUsage());
+	}
+	return stats;
+}
+
+CollectionStats& CollectionStats::operator+=(const CollectionStats& other)
+{
+	document_count += other.document_count;
+	word_count += other.word_count;
+	for (const auto& [word, document_freq] : other.document_freqs)
+	{
+		document_freqs[word] += document_freq;
+	}
+	return *this;
+}
+
+CollectionStats SearchServer::GetCollectionStats(std::string_view raw_query) const
+{
+	const Query query = ParseQuery(raw_query, true);
+	CollectionStats stats;
+	stats.document_count = documents_.size();
+	stats.word_count = total_word_count_;
+	for (std::string_view word : query.plus_words)
+	{
+		const auto it = word_to_document_freqs_.find(word);
+		stats.document_freqs.emplace(word, it == word_to_document_freqs_.end() ? 0 : it->second.size());
+	}
+	return stats;
+}
+
+std::vector<std::string_view> SearchServer::FindWordsByPrefix(std::string_view prefix, size_t limit) const
+{
+	std::vector<std::string_view> result;
+	for (auto it = words_.lower_bound(prefix); it != words_.end() && result.size() < limit; ++it)
+	{
+		const std::string_view word = *it;
+		if (word.substr(0, prefix.size()) != prefix)
+		{
+			break;
+		}
+		// Words stay in the dictionary after their last document is removed
+		const auto postings_it = word_to_document_freqs_.find(word);
+		if (postings_it != word_to_document_freqs_.end() && !postings_it->second.empty())
+		{
+			result.push_back(word);
+		}
+	}
+	return result;
+}
+
+std::string SearchServer::GetDocumentContent(int document_id) const
+{
+	if (documents_.count(document_id) == 0)
+	{
+		throw std::out_of_range("Invalid document_id");
+	}
+	if (!content_store_)
+	{
+		throw std::logic_error("Document texts are not stored");
+	}
+	return content_store_->Get(document_id);
 }
 
 void SearchServer::RemoveDocument(int document_id)
@@ -82,6 +282,41 @@ void SearchServer::RemoveDocument(int document_id)
 	RemoveDocument(std::execution::seq, document_id);
 }
 
+void SearchServer::UpdateDocumentStatus(int document_id, DocumentStatus status)
+{
+	GetDocumentData(document_id).status.store(status, std::memory_order_relaxed);
+}
+
+void SearchServer::UpdateDocumentRatings(int document_id, const std::vector<int>& ratings)
+{
+	GetDocumentData(document_id).rating.store(ComputeAverageRating(ratings), std::memory_order_relaxed);
+}
+
+DocumentStatus SearchServer::GetDocumentStatus(int document_id) const
+{
+	return GetDocumentData(document_id).status.load(std::memory_order_relaxed);
+}
+
+int SearchServer::GetDocumentRating(int document_id) const
+{
+	return GetDocumentData(document_id).rating.load(std::memory_order_relaxed);
+}
+
+const SearchServer::DocumentData& SearchServer::GetDocumentData(int document_id) const
+{
+	const auto it = documents_.find(document_id);
+	if (it == documents_.end())
+	{
+		throw std::out_of_range("Invalid document_id"s);
+	}
+	return it->second;
+}
+
+SearchServer::DocumentData& SearchServer::GetDocumentData(int document_id)
+{
+	return const_cast<DocumentData&>(std::as_const(*this).GetDocumentData(document_id));
+}
+
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
 	const std::string_view& raw_query, int document_id) const
 {
@@ -94,81 +329,528 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 		throw std::invalid_argument("Invalid query");
 	}
 
-	auto query = ParseQuery(raw_query, true);
+	return MatchParsedQuery(ParseQuery(raw_query, true), document_id);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id) const
+{
+	return MatchDocument(raw_query, document_id);
+}
 
-	for (std::string_view word : query.minus_words)
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
+	std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const
+{
+	// One document is a handful of lookups, too little to split between threads;
+	// the parallel version only shares the parsing and matching of the sequential one
+	return MatchDocument(raw_query, document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+	std::string_view raw_query, const std::vector<int>& document_ids) const
+{
+	return MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+	std::execution::sequenced_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const
+{
+	if (!IsValidWord(raw_query))
 	{
-		if (word_to_document_freqs_.count(word) == 0)
+		throw std::invalid_argument("Invalid query");
+	}
+	return MatchDocuments(policy, ParseQuery(raw_query, true), document_ids);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+	std::execution::parallel_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const
+{
+	if (!IsValidWord(raw_query))
+	{
+		throw std::invalid_argument("Invalid query");
+	}
+	return MatchDocuments(policy, ParseQuery(raw_query, true), document_ids);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchParsedQuery(
+	const Query& query, int document_id) const
+{
+	const auto& word_freqs = document_to_word_freqs_.at(document_id);
+	const DocumentStatus status = documents_.at(document_id).status.load();
+
+	// Both the query words and the document words are sorted: a short query is
+	// looked up word by word, a long one is merged with the document in one pass
+	auto intersect = [&word_freqs](const std::vector<std::string_view>& words, auto on_match)
+	{
+		if (words.size() * 8 < word_freqs.size())
 		{
-			continue;
+			for (std::string_view word : words)
+			{
+				const auto it = word_freqs.find(word);
+				if (it != word_freqs.end() && !on_match(it->first))
+				{
+					return;
+				}
+			}
+			return;
 		}
-		if (word_to_document_freqs_.at(word).count(document_id))
+
+		auto document_it = word_freqs.begin();
+		auto query_it = words.begin();
+		while (document_it != word_freqs.end() && query_it != words.end())
 		{
-			return { std::vector<std::string_view>{}, documents_.at(document_id).status };
+			if (document_it->first < *query_it)
+			{
+				++document_it;
+			}
+			else if (*query_it < document_it->first)
+			{
+				++query_it;
+			}
+			else
+			{
+				if (!on_match(document_it->first))
+				{
+					return;
+				}
+				++document_it;
+				++query_it;
+			}
 		}
-	}
+	};
 
-	std::vector<std::string_view> matched_words; 
+	bool has_minus_word = false;
+	intersect(query.minus_words, [&has_minus_word](std::string_view)
+		{
+			has_minus_word = true;
+			return false;
+		});
+	if (has_minus_word)
+	{
+		return { std::vector<std::string_view>{}, status };
+	}
 
-	for (std::string_view word : query.plus_words)
+	size_t required_found = 0;
+	intersect(query.required_words, [&required_found](std::string_view)
+		{
+			++required_found;
+			return true;
+		});
+	if (required_found < query.required_words.size())
+	{
+		return { std::vector<std::string_view>{}, status };
+	}
+	for (const auto& phrase : query.phrases)
 	{
-		if (word_to_document_freqs_.count(word) == 0)
+		if (!ContainsPhrase(phrase, document_id))
 		{
-			continue;
-		}
-		if (word_to_document_freqs_.at(word).count(document_id))
-		{ 
-			matched_words.push_back((word));
+			return { std::vector<std::string_view>{}, status };
 		}
 	}
 
-	return { matched_words, documents_.at(document_id).status };
+	std::vector<std::string_view> matched_words;
+	intersect(query.plus_words, [&matched_words](std::string_view word)
+		{
+			matched_words.push_back(word);
+			return true;
+		});
+	return { matched_words, status };
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id) const
+size_t SearchServer::GetLongestPostingList(const std::vector<std::string_view>& words) const
 {
-	return MatchDocument(raw_query, document_id);
+	size_t longest = 0;
+	for (std::string_view word : words)
+	{
+		const auto it = word_to_document_freqs_.find(word);
+		if (it != word_to_document_freqs_.end())
+		{
+			longest = std::max(longest, it->second.size());
+		}
+	}
+	return longest;
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
-	std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const
+	AdaptiveExecutionPolicy policy, std::string_view raw_query, int document_id) const
+{
+	// A single document is matched through its own word list, that never pays for threads
+	return MatchDocument(raw_query, document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+	AdaptiveExecutionPolicy policy, std::string_view raw_query, const std::vector<int>& document_ids) const
 {
-	if (document_id < 0 || documents_.count(document_id) == 0)
-	{
-		throw std::out_of_range("Invalid document_id");
-	}
 	if (!IsValidWord(raw_query))
 	{
 		throw std::invalid_argument("Invalid query");
 	}
+	const Query query = ParseQuery(raw_query, true);
 
-	Query query = ParseQuery(raw_query, false);
+	// Every document costs about one lookup per query word
+	const size_t work = document_ids.size() * (query.plus_words.size() + query.minus_words.size());
+	if (work >= GetExecutionThresholds().parallel_min_postings)
+	{
+		return MatchDocuments(std::execution::par, query, document_ids);
+	}
+	return MatchDocuments(std::execution::seq, query, document_ids);
+}
 
-	if (any_of(
-		std::execution::par,
-		query.minus_words.begin(), query.minus_words.end(),
-		[this, document_id](const std::string_view& word)
+namespace
+{
+	std::atomic<size_t> parallel_min_postings{ 0 };
+	std::atomic<size_t> blocked_min_postings{ 0 };
+	std::once_flag thresholds_calibrated;
+	// Set while the calibration builds its own SearchServer
+	thread_local bool calibrating = false;
+}
+
+ExecutionThresholds SearchServer::GetExecutionThresholds()
+{
+	CalibrateExecution();
+	return { parallel_min_postings.load(std::memory_order_relaxed), blocked_min_postings.load(std::memory_order_relaxed) };
+}
+
+void SearchServer::SetExecutionThresholds(const ExecutionThresholds& thresholds)
+{
+	// Explicit thresholds replace the calibration, so it must not run afterwards
+	std::call_once(thresholds_calibrated, [] {});
+	parallel_min_postings.store(thresholds.parallel_min_postings, std::memory_order_relaxed);
+	blocked_min_postings.store(thresholds.blocked_min_postings, std::memory_order_relaxed);
+}
+
+void SearchServer::CalibrateExecution()
+{
+	if (calibrating)
+	{
+		return;
+	}
+	std::call_once(thresholds_calibrated, []
 		{
-			return word_to_document_freqs_.at(word).count(document_id);
-		})) {
-		return { std::vector<std::string_view>(), documents_.at(document_id).status };
+			calibrating = true;
+			const ExecutionThresholds thresholds = MeasureExecutionThresholds();
+			calibrating = false;
+			parallel_min_postings.store(thresholds.parallel_min_postings, std::memory_order_relaxed);
+			blocked_min_postings.store(thresholds.blocked_min_postings, std::memory_order_relaxed);
+		});
+}
+
+ExecutionThresholds SearchServer::MeasureExecutionThresholds()
+{
+	const unsigned thread_count = std::thread::hardware_concurrency();
+	if (thread_count <= 1)
+	{
+		return { std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max() };
 	}
 
-	std::vector<std::string_view> matched_words(query.plus_words.size());
-	std::copy_if(
-		std::execution::par,
-		query.plus_words.begin(), query.plus_words.end(),
-		matched_words.begin(),
-		[this, document_id](const std::string_view& word)
+	using Clock = std::chrono::steady_clock;
+	auto best_time = [](int runs, auto func)
+	{
+		double best = std::numeric_limits<double>::max();
+		for (int i = 0; i < runs; ++i)
+		{
+			const auto start = Clock::now();
+			func();
+			best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+		}
+		return best;
+	};
+
+	// Sequential cost of one posting, measured on a single-word index that
+	// stores no texts and leaves the application's metrics alone
+	QueryMetrics::Pause metrics_pause;
+	const int posting_count = 1 << 15;
+	const std::string_view word = "calibration";
+	IndexOptions options;
+	options.store_content = false;
+	SearchServer server(std::vector<std::string>{}, options);
+	for (int document_id = 0; document_id < posting_count; ++document_id)
+	{
+		server.AddDocument(document_id, word, DocumentStatus::ACTUAL, {});
+	}
+	const Query query = server.ParseQuery(word, true);
+	const double sequential_ns = best_time(3, [&]
 		{
-			return word_to_document_freqs_.at(word).count(document_id);
+			server.FindAllDocumentsByWord<TfIdfScorer>(std::execution::seq, query,
+				[](int, DocumentStatus, int) { return true; });
 		});
+	const double posting_ns = sequential_ns / posting_count;
+
+	// Fixed price of forking and joining the thread pool
+	std::vector<int> tasks(thread_count);
+	const double fork_join_ns = best_time(5, [&]
+		{
+			std::for_each(std::execution::par, tasks.begin(), tasks.end(), [](int& task) { ++task; });
+		});
+
+	// Going parallel saves posting_ns * n * (1 - 1 / threads) and costs fork_join_ns;
+	// require the saving to be twice the cost. The floor guards against a pool
+	// that ran the tasks inline and made the fork look free
+	const double parallel_min = 2.0 * fork_join_ns / (posting_ns * (1.0 - 1.0 / thread_count));
+	const size_t parallel_min_postings = static_cast<size_t>(std::clamp(parallel_min, 4096.0, 1e15));
+	return { parallel_min_postings, std::max(parallel_min_postings, 2 * SCORING_BLOCK_SIZE) };
+}
+
+void SearchServer::EraseDocuments(const std::map<int, double>& postings, std::map<int, double>& document_to_relevance)
+{
+	if (postings.size() < document_to_relevance.size())
+	{
+		for (const auto& [document_id, _] : postings)
+		{
+			document_to_relevance.erase(document_id);
+		}
+	}
+	else
+	{
+		for (auto document_it = document_to_relevance.begin(); document_it != document_to_relevance.end();)
+		{
+			document_it = postings.count(document_it->first) > 0
+				? document_to_relevance.erase(document_it) : std::next(document_it);
+		}
+	}
+}
+
+std::vector<int> SearchServer::IntersectRequiredWords(const Query& query) const
+{
+	std::vector<const std::map<int, double>*> postings;
+	for (std::string_view word : query.required_words)
+	{
+		const auto it = word_to_document_freqs_.find(word);
+		if (it == word_to_document_freqs_.end() || it->second.empty())
+		{
+			return {};
+		}
+		postings.push_back(&it->second);
+	}
+
+	// Start from the rarest word: the candidate list only shrinks from there
+	std::sort(postings.begin(), postings.end(),
+		[](const auto* lhs, const auto* rhs) { return lhs->size() < rhs->size(); });
+
+	std::vector<int> candidates;
+	candidates.reserve(postings.front()->size());
+	for (const auto& [document_id, _] : *postings.front())
+	{
+		candidates.push_back(document_id);
+	}
+
+	for (size_t i = 1; i < postings.size() && !candidates.empty(); ++i)
+	{
+		const auto& word_postings = *postings[i];
+		auto kept = candidates.begin();
+
+		// Few candidates against a long list: search the tree for each of them,
+		// which skips most of the list like a galloping search would.
+		// Comparable sizes: a linear merge touches fewer nodes
+		const size_t search_cost = candidates.size() * static_cast<size_t>(std::log2(word_postings.size() + 1) + 1);
+		if (search_cost < word_postings.size())
+		{
+			for (const int document_id : candidates)
+			{
+				if (word_postings.count(document_id) > 0)
+				{
+					*kept++ = document_id;
+				}
+			}
+		}
+		else
+		{
+			auto posting_it = word_postings.begin();
+			for (const int document_id : candidates)
+			{
+				while (posting_it != word_postings.end() && posting_it->first < document_id)
+				{
+					++posting_it;
+				}
+				if (posting_it == word_postings.end())
+				{
+					break;
+				}
+				if (posting_it->first == document_id)
+				{
+					*kept++ = document_id;
+				}
+			}
+		}
+		candidates.erase(kept, candidates.end());
+	}
+
+	for (const auto& phrase : query.phrases)
+	{
+		candidates.erase(
+			std::remove_if(candidates.begin(), candidates.end(),
+				[this, &phrase](int document_id) { return !ContainsPhrase(phrase, document_id); }),
+			candidates.end());
+	}
+	return candidates;
+}
+
+void SearchServer::ExpandPrefix(std::string_view prefix, size_t max_words, std::vector<std::string_view>& words) const
+{
+	// Posting counts and words; once max_words are kept it is a heap with the rarest on top
+	std::vector<std::pair<size_t, std::string_view>> expansions;
+	auto more_frequent = [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; };
+
+	for (auto it = word_to_document_freqs_.lower_bound(prefix);
+		it != word_to_document_freqs_.end() && it->first.substr(0, prefix.size()) == prefix; ++it)
+	{
+		const size_t posting_count = it->second.size();
+		if (posting_count == 0)
+		{
+			continue;
+		}
+		if (expansions.size() < max_words)
+		{
+			expansions.emplace_back(posting_count, it->first);
+			if (expansions.size() == max_words)
+			{
+				std::make_heap(expansions.begin(), expansions.end(), more_frequent);
+			}
+		}
+		else if (max_words > 0 && posting_count > expansions.front().first)
+		{
+			std::pop_heap(expansions.begin(), expansions.end(), more_frequent);
+			expansions.back() = { posting_count, it->first };
+			std::push_heap(expansions.begin(), expansions.end(), more_frequent);
+		}
+	}
+	for (const auto& [_, word] : expansions)
+	{
+		words.push_back(word);
+	}
+}
+
+std::vector<std::pair<std::string_view, int>> SearchServer::FindFuzzyWords(std::string_view word, int max_distance) const
+{
+	const LevenshteinAutomaton automaton(word, max_distance);
+	std::vector<std::pair<std::string_view, int>> result;
+
+	// states[i] is the automaton state after the first i characters of `previous`
+	std::vector<LevenshteinAutomaton::State> states{ automaton.Start() };
+	std::string_view previous;
+
+	auto it = words_.begin();
+	while (it != words_.end())
+	{
+		const std::string_view candidate = *it;
+		const size_t common_size = std::mismatch(
+			previous.begin(), previous.begin() + std::min(previous.size(), states.size() - 1),
+			candidate.begin(), candidate.end()).first - previous.begin();
+		states.resize(common_size + 1);
+
+		size_t depth = common_size;
+		for (; depth < candidate.size(); ++depth)
+		{
+			auto next = automaton.Step(states.back(), candidate[depth]);
+			if (!automaton.CanMatch(next))
+			{
+				break;
+			}
+			states.push_back(std::move(next));
+		}
+		previous = candidate;
+
+		if (depth < candidate.size())
+		{
+			// No word starting with candidate[0..depth] can match: jump past all of them
+			std::string successor(candidate.substr(0, depth + 1));
+			while (!successor.empty() && static_cast<unsigned char>(successor.back()) == 0xFF)
+			{
+				successor.pop_back();
+			}
+			if (successor.empty())
+			{
+				break;
+			}
+			++successor.back();
+			it = words_.lower_bound(successor);
+			continue;
+		}
+
+		if (automaton.IsMatch(states.back()))
+		{
+			const auto postings_it = word_to_document_freqs_.find(candidate);
+			if (postings_it != word_to_document_freqs_.end() && !postings_it->second.empty())
+			{
+				result.emplace_back(candidate, automaton.Distance(states.back()));
+			}
+		}
+		++it;
+	}
+	return result;
+}
 
-	std::sort(std::execution::par, matched_words.begin(), matched_words.end());
-	auto it = unique(std::execution::par, matched_words.begin(), matched_words.end());
-	matched_words.erase(it - 1, matched_words.end());
+bool SearchServer::ContainsPhrase(const std::vector<std::string_view>& phrase, int document_id) const
+{
+	auto decode = [this, document_id](std::string_view word)
+	{
+		std::vector<uint32_t> positions;
+		const auto word_it = word_to_document_positions_.find(word);
+		if (word_it == word_to_document_positions_.end())
+		{
+			return positions;
+		}
+		const auto document_it = word_it->second.find(document_id);
+		if (document_it == word_it->second.end())
+		{
+			return positions;
+		}
+		std::string_view encoded = document_it->second;
+		uint64_t delta = 0;
+		uint32_t position = 0;
+		while (ReadVarint(encoded, delta))
+		{
+			position += static_cast<uint32_t>(delta);
+			positions.push_back(position);
+		}
+		return positions;
+	};
 
-	return { matched_words, documents_.at(document_id).status }; 
+	// Start positions of the phrase: positions of the first word, kept only
+	// while the i-th word is found i positions further
+	std::vector<uint32_t> starts = decode(phrase.front());
+	for (size_t i = 1; i < phrase.size() && !starts.empty(); ++i)
+	{
+		const std::vector<uint32_t> positions = decode(phrase[i]);
+		std::vector<uint32_t> kept;
+		auto position_it = positions.begin();
+		for (const uint32_t start : starts)
+		{
+			position_it = std::lower_bound(position_it, positions.end(), start + static_cast<uint32_t>(i));
+			if (position_it != positions.end() && *position_it == start + i)
+			{
+				kept.push_back(start);
+			}
+		}
+		starts = std::move(kept);
+	}
+	return !starts.empty();
+}
+
+SearchServer::ExecutionMode SearchServer::ChooseExecutionMode(const Query& query) const
+{
+	size_t total_postings = 0;
+	size_t longest_postings = 0;
+	for (std::string_view word : query.plus_words)
+	{
+		const auto it = word_to_document_freqs_.find(word);
+		if (it != word_to_document_freqs_.end())
+		{
+			total_postings += it->second.size();
+			longest_postings = std::max(longest_postings, it->second.size());
+		}
+	}
+
+	const ExecutionThresholds thresholds = GetExecutionThresholds();
+	if (longest_postings >= thresholds.blocked_min_postings)
+	{
+		return ExecutionMode::BLOCKED;
+	}
+	// Words are the unit of work without blocks, a single word cannot be split
+	if (total_postings >= thresholds.parallel_min_postings && query.plus_words.size() > 1)
+	{
+		return ExecutionMode::PARALLEL;
+	}
+	return ExecutionMode::SEQUENTIAL;
 }
 
 bool SearchServer::IsValidWord(const std::string_view& word)
@@ -214,25 +896,165 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
 	}
 
 	bool is_minus = false;
+	bool is_required = false;
 	if (text[0] == '-')
 	{
 		is_minus = true;
 		text = text.substr(1);
 	}
-	if (text.empty() || text[0] == '-' || !IsValidWord(text))
+	else if (text[0] == '+')
+	{
+		is_required = true;
+		text = text.substr(1);
+	}
+	if (text.empty() || text[0] == '-' || text[0] == '+' || !IsValidWord(text))
 	{
 		throw std::invalid_argument("Query word "s + static_cast<std::string>(text) + " is invalid"s);
 	}
-	return { text, is_minus, IsStopWord(text) };
+	return { text, is_minus, is_required, IsStopWord(text) };
+}
+
+QueryClass SearchServer::ClassifyQuery(const Query& query)
+{
+	if (!query.required_words.empty())
+	{
+		return QueryClass::CONJUNCTIVE;
+	}
+	if (!query.minus_words.empty())
+	{
+		return QueryClass::MINUS_WORDS;
+	}
+	return query.plus_words.size() > 1 ? QueryClass::MULTI_WORD : QueryClass::SINGLE_WORD;
 }
 
 SearchServer::Query SearchServer::ParseQuery(std::string_view text, const bool b) const
 {
 	Query result;
+	std::vector<std::string_view> phrase;
+	bool in_phrase = false;
+	// Words of the open phrase, stop words included
+	size_t phrase_word_count = 0;
 
 	for (std::string_view word : SplitIntoWords(text))
 	{
+		if (!word.empty() && word.front() == '"' && !in_phrase)
+		{
+			in_phrase = true;
+			word.remove_prefix(1);
+		}
+		if (in_phrase)
+		{
+			const bool phrase_ends = !word.empty() && word.back() == '"';
+			if (phrase_ends)
+			{
+				word.remove_suffix(1);
+			}
+
+			// A quote standing apart from the words opens or closes the phrase alone
+			if (!word.empty())
+			{
+				const auto query_word = ParseQueryWord(word);
+				if (query_word.is_minus || query_word.is_required)
+				{
+					throw std::invalid_argument("Query word "s + static_cast<std::string>(word) + " is invalid in a phrase"s);
+				}
+				if (!query_word.is_stop)
+				{
+					phrase.push_back(query_word.data);
+					result.plus_words.push_back(query_word.data);
+					result.required_words.push_back(query_word.data);
+				}
+				++phrase_word_count;
+			}
+
+			if (phrase_ends)
+			{
+				if (phrase_word_count == 0)
+				{
+					throw std::invalid_argument("Unbalanced or empty phrase"s);
+				}
+				in_phrase = false;
+				phrase_word_count = 0;
+				if (phrase.size() > 1)
+				{
+					if (!options_.store_positions)
+					{
+						throw std::invalid_argument("Phrase queries need the positional index"s);
+					}
+					result.phrases.push_back(std::move(phrase));
+				}
+				phrase.clear();
+			}
+			continue;
+		}
+
 		const auto query_word = ParseQueryWord(word);
+		// Only "word~" and "word~D" with D from 1 to MAX_FUZZY_DISTANCE are fuzzy,
+		// other words with '~', "word~0" and "word~7" among them, are plain words
+		const size_t fuzzy_mark = query_word.data.find('~');
+		const std::string_view distance_text = fuzzy_mark == std::string_view::npos
+			? std::string_view() : query_word.data.substr(fuzzy_mark + 1);
+		if (fuzzy_mark != std::string_view::npos && fuzzy_mark > 0
+			&& (distance_text.empty() || (distance_text.size() == 1
+				&& distance_text.front() >= '1' && distance_text.front() <= '0' + MAX_FUZZY_DISTANCE)))
+		{
+			const int max_distance = distance_text.empty() ? 1 : distance_text.front() - '0';
+			if (query_word.is_required)
+			{
+				throw std::invalid_argument("Query word "s + static_cast<std::string>(word) + " is invalid"s);
+			}
+			// A stop word is ignored with its misspellings, the stop words themselves are never indexed
+			const std::string_view fuzzy_word = query_word.data.substr(0, fuzzy_mark);
+			if (IsStopWord(fuzzy_word))
+			{
+				continue;
+			}
+
+			auto matches = FindFuzzyWords(fuzzy_word, max_distance);
+			// A document with any match must be excluded, so minus-words are not capped
+			if (!query_word.is_minus && matches.size() > MAX_FUZZY_EXPANSIONS)
+			{
+				std::nth_element(matches.begin(), matches.begin() + MAX_FUZZY_EXPANSIONS, matches.end(),
+					[](const auto& lhs, const auto& rhs) { return lhs.second < rhs.second; });
+				matches.resize(MAX_FUZZY_EXPANSIONS);
+			}
+			for (const auto& [match, distance] : matches)
+			{
+				if (query_word.is_minus)
+				{
+					result.minus_words.push_back(match);
+					continue;
+				}
+				if (distance > 0)
+				{
+					double& weight = result.word_weights.try_emplace(match, 0.0).first->second;
+					weight = std::max(weight, std::pow(FUZZY_MATCH_WEIGHT, distance));
+				}
+				else
+				{
+					result.plus_words.push_back(match);
+				}
+			}
+			continue;
+		}
+		if (query_word.data.size() > 1 && query_word.data.back() == '*')
+		{
+			if (query_word.is_required)
+			{
+				throw std::invalid_argument("Query word "s + static_cast<std::string>(word) + " can't be both required and a prefix"s);
+			}
+			const std::string_view prefix = query_word.data.substr(0, query_word.data.size() - 1);
+			// A document with any match must be excluded, so minus-words are not capped
+			if (query_word.is_minus)
+			{
+				ExpandPrefix(prefix, std::numeric_limits<size_t>::max(), result.minus_words);
+			}
+			else
+			{
+				ExpandPrefix(prefix, MAX_PREFIX_EXPANSIONS, result.plus_words);
+			}
+			continue;
+		}
 		if (!query_word.is_stop)
 		{
 			if (query_word.is_minus)
@@ -242,10 +1064,33 @@ SearchServer::Query SearchServer::ParseQuery(std::string_view text, const bool b
 			else
 			{
 				result.plus_words.push_back(query_word.data);
+				if (query_word.is_required)
+				{
+					result.required_words.push_back(query_word.data);
+				}
 			}
 		}
 	}
 
+	if (in_phrase)
+	{
+		throw std::invalid_argument("Unbalanced or empty phrase"s);
+	}
+
+	// A word that is also a plus-word on its own keeps its full weight
+	for (auto it = result.word_weights.begin(); it != result.word_weights.end();)
+	{
+		if (std::find(result.plus_words.begin(), result.plus_words.end(), it->first) != result.plus_words.end())
+		{
+			it = result.word_weights.erase(it);
+		}
+		else
+		{
+			result.plus_words.push_back(it->first);
+			++it;
+		}
+	}
+
 	if (b == true)
 	{
 		std::sort(result.plus_words.begin(), result.plus_words.end());
@@ -255,6 +1100,10 @@ SearchServer::Query SearchServer::ParseQuery(std::string_view text, const bool b
 		std::sort(result.minus_words.begin(), result.minus_words.end());
 		result.minus_words.erase(std::unique(result.minus_words.begin(), result.minus_words.end()),
 			result.minus_words.end());
+
+		std::sort(result.required_words.begin(), result.required_words.end());
+		result.required_words.erase(std::unique(result.required_words.begin(), result.required_words.end()),
+			result.required_words.end());
 		  
 		return result;
 	}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <deque>
 #include <map>
@@ -9,16 +10,24 @@
 #include <utility>
 #include <vector>
 #include <numeric>
+#include <optional>
 #include <string> 
 #include <string_view>
 #include <iterator>
 #include <execution>
+#include <atomic>
+#include <memory>
 
 
 #include "concurrent_map.h"
 #include "read_input_functions.h"
 #include "string_processing.h"
 #include "document.h"
+#include "document_store.h"
+#include "memory_stats.h"
+#include "perf_counters.h"
+#include "query_metrics.h"
+#include "scoring.h"
 
 // #include "tbb/blocked_range.h"
 
@@ -27,15 +36,117 @@ using namespace std::string_literals;
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 constexpr double EPSILON = 1e-6;
 
+// Parallel queries whose longest posting list reaches BLOCKED_SCORING_MIN_POSTINGS
+// are scored by document id blocks of about SCORING_BLOCK_SIZE postings
+const size_t BLOCKED_SCORING_MIN_POSTINGS = 1 << 16;
+const size_t SCORING_BLOCK_SIZE = 1 << 14;
+const size_t MAX_SCORING_BLOCKS = 1 << 10;
+
+// A query word "prefix*" is replaced by at most this many dictionary words,
+// the most frequent ones are kept. "-prefix*" excludes every match and is not
+// capped: a dropped match would let its documents through. It costs one pass
+// over the matching words and a minus-filter over each one's postings
+const size_t MAX_PREFIX_EXPANSIONS = 256;
+
+// A query word "word~" or "word~2" also matches the dictionary words within
+// one or two edits. Every edit multiplies the relevance of a match by
+// FUZZY_MATCH_WEIGHT; at most MAX_FUZZY_EXPANSIONS closest words are used.
+// "-word~" excludes every match
+const int MAX_FUZZY_DISTANCE = 2;
+const double FUZZY_MATCH_WEIGHT = 0.5;
+const size_t MAX_FUZZY_EXPANSIONS = 64;
+
+// A query with a time limit reads the clock once per this many postings
+const size_t BUDGET_CLOCK_INTERVAL = 64;
+
+// Execution policy tag: the server estimates the work of every query from the
+// document frequencies of its words and picks sequential, per-word parallel
+// or blocked parallel execution by itself
+struct AdaptiveExecutionPolicy {};
+inline constexpr AdaptiveExecutionPolicy adaptive_execution{};
+
+// Cost model of adaptive_execution, in postings to be scanned by a query
+struct ExecutionThresholds
+{
+	size_t parallel_min_postings;
+	size_t blocked_min_postings;
+};
+
+struct IndexOptions
+{
+	// Keep the positions of every word in every document, needed by "phrase" queries
+	bool store_positions = false;
+	// Keep the document texts for GetDocumentContent. They are compressed in
+	// blocks of content_block_size bytes, spilled to content_spill_path if it is set
+	bool store_content = true;
+	size_t content_block_size = 1 << 16;
+	std::string content_spill_path;
+};
+
+// Limits of a single query, zero means no limit. The time limit counts from
+// the call, so parsing is included
+struct QueryBudget
+{
+	std::chrono::steady_clock::duration time_limit{};
+	size_t max_postings = 0;
+};
+
+struct SearchResult
+{
+	std::vector<Document> documents;
+	// The budget ran out before every posting was scored
+	bool is_partial = false;
+};
+
+// Statistics of a collection split into partitions, one SearchServer each.
+// Summed over all the partitions they let every partition rank its documents
+// as a single index over the whole collection would
+struct CollectionStats
+{
+	uint64_t document_count = 0;
+	// Non-stop words of all the documents
+	uint64_t word_count = 0;
+	// Of the plus-words of one query
+	std::map<std::string, uint64_t, std::less<>> document_freqs;
+
+	CollectionStats& operator+=(const CollectionStats& other);
+
+	ScoringStats GetScoringStats() const
+	{
+		return { document_count * 1.0, document_count == 0 ? 0.0 : word_count * 1.0 / document_count };
+	}
+};
+
+// Result order: relevance, then rating, then id, so that every document has a
+// stable position a SearchAfter cursor can point to
+inline bool IsRankedHigher(const Document& lhs, const Document& rhs)
+{
+	if (std::abs(lhs.relevance - rhs.relevance) >= EPSILON)
+	{
+		return lhs.relevance > rhs.relevance;
+	}
+	if (lhs.rating != rhs.rating)
+	{
+		return lhs.rating > rhs.rating;
+	}
+	return lhs.id < rhs.id;
+}
+
 
 class SearchServer
 {
 public:
 	template <typename StringContainer>
-	explicit SearchServer(const StringContainer& stop_words);
+	explicit SearchServer(const StringContainer& stop_words, IndexOptions options = {});
+
+	explicit SearchServer(const std::string& stop_words_text, IndexOptions options = {});
+	explicit SearchServer(const std::string_view& stop_words_text, IndexOptions options = {});
 
-	explicit SearchServer(const std::string& stop_words_text);
-	explicit SearchServer(const std::string_view& stop_words_text);
+	// Not copyable: the index holds string_views into words_ and the document
+	// attributes are atomics. A move keeps every map node where it is
+	SearchServer(const SearchServer&) = delete;
+	SearchServer& operator=(const SearchServer&) = delete;
+	SearchServer(SearchServer&&) = default;
 
 	void AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
 		const std::vector<int>& ratings);
@@ -69,6 +180,80 @@ public:
 		return FindTopDocuments(std::execution::par, raw_query, DocumentStatus::ACTUAL);
 	}
 
+	std::vector<Document> FindTopDocuments(const AdaptiveExecutionPolicy&,
+		std::string_view raw_query, DocumentStatus status) const;
+
+	std::vector<Document> FindTopDocuments(const AdaptiveExecutionPolicy&, std::string_view raw_query) const {
+		return FindTopDocuments(adaptive_execution, raw_query, DocumentStatus::ACTUAL);
+	}
+
+	// Next page of page_size results following the `after` cursor.
+	// Only the page is sorted, the rest of the matches are never ordered
+	template <typename DocumentPredicate, typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		DocumentPredicate document_predicate, const SearchAfter& after, size_t page_size) const;
+
+	// The same searches ranked by another scoring model, for example
+	// FindTopDocuments<Bm25Scorer>(std::execution::par, raw_query, DocumentStatus::ACTUAL).
+	// The predicate may also be a DocumentStatus
+	template <typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		DocumentPredicate document_predicate, const SearchAfter& after = {},
+		size_t page_size = MAX_RESULT_DOCUMENT_COUNT) const;
+
+	template <typename Scorer, typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const {
+		return FindTopDocuments<Scorer>(policy, raw_query, DocumentStatus::ACTUAL);
+	}
+
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		DocumentStatus status, const SearchAfter& after, size_t page_size) const
+	{
+		return FindTopDocuments(policy, raw_query,
+			[status](int document_id, DocumentStatus document_status, int rating)
+			{
+				return document_status == status;
+			},
+			after, page_size);
+	}
+
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, const SearchAfter& after, size_t page_size) const {
+		return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL, after, page_size);
+	}
+
+	// The best documents found before the budget runs out. Scoring goes from the
+	// rarest plus-word to the most common one, so a cut-off loses the postings
+	// that weigh least. Queries with required words are scored in document id
+	// order instead. The predicate may also be a DocumentStatus
+	template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
+	SearchResult FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+		const QueryBudget& budget) const;
+
+	SearchResult FindTopDocuments(std::string_view raw_query, const QueryBudget& budget) const {
+		return FindTopDocuments(raw_query, DocumentStatus::ACTUAL, budget);
+	}
+
+	// The local statistics of a query, to be summed over the partitions of a
+	// collection. Prefix and fuzzy words count with the expansions of this index
+	CollectionStats GetCollectionStats(std::string_view raw_query) const;
+
+	// The best count documents of this partition, ranked with the statistics of
+	// the whole collection. Sequential; a word missing from the statistics
+	// counts with its local document frequency
+	template <typename Scorer = TfIdfScorer>
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+		const CollectionStats& collection, size_t count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+	// Runs a batch of queries, each ranked as FindTopDocuments would. The postings
+	// of every distinct word of the batch are scanned once per document id block
+	// and their scores scattered to the queries using the word, so hot words
+	// shared by many queries cost one traversal. Queries with required words or
+	// phrases are run one by one. Takes std::execution::seq or par
+	template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+	std::vector<std::vector<Document>> FindTopDocumentsBatch(ExecutionPolicy&& policy,
+		const std::vector<std::string>& raw_queries, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
 	int GetDocumentCount() const { return documents_.size(); }
 
 	int GetDocumentId(int index) const { return document_ids_.count(index); }
@@ -81,11 +266,33 @@ public:
 
 	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+	// Throws std::out_of_range for an unknown document and
+	// std::logic_error if the server doesn't store texts
+	std::string GetDocumentContent(int document_id) const;
+
+	// Estimated heap usage of every index structure and the posting list
+	// lengths. Linear in words and documents, never walks the postings
+	MemoryStats GetMemoryStats() const;
+
+	// Indexed words starting with prefix, in lexicographical order
+	std::vector<std::string_view> FindWordsByPrefix(std::string_view prefix, size_t limit) const;
+
 	void RemoveDocument(int document_id);
 
 	template<class ExecutionPolicy>
 	void RemoveDocument(ExecutionPolicy&& policy, int document_id);
 
+	// Change only the document attributes, the word index is left untouched.
+	// Safe to call while other threads run queries: each attribute is swapped atomically
+	void UpdateDocumentStatus(int document_id, DocumentStatus status);
+
+	void UpdateDocumentRatings(int document_id, const std::vector<int>& ratings);
+
+	DocumentStatus GetDocumentStatus(int document_id) const;
+
+	// Average rating
+	int GetDocumentRating(int document_id) const;
+
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
 		const std::string_view& raw_query, int document_id) const;
 
@@ -95,21 +302,62 @@ public:
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
 		std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const;
 
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
+		AdaptiveExecutionPolicy policy, std::string_view raw_query, int document_id) const;
+
+	// Matches one query against many documents: the query is parsed once and
+	// every document is checked through its own word list
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+		std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+		std::execution::sequenced_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+		std::execution::parallel_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+		AdaptiveExecutionPolicy policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+	// Thresholds used by adaptive_execution. On a multi-core machine the first
+	// SearchServer constructed calibrates them with a micro-benchmark, which takes
+	// up to a few hundred milliseconds, unless SetExecutionThresholds came first
+	static ExecutionThresholds GetExecutionThresholds();
+	static void SetExecutionThresholds(const ExecutionThresholds& thresholds);
+	static void CalibrateExecution();
+
 private:
+	// Runs the stages of a query as coroutines, see query_pipeline.h
+	friend class QueryPipeline;
+
 	struct DocumentData
 	{
-		int rating;
-		DocumentStatus status;
-		std::string content;
+		DocumentData(int rating, DocumentStatus status, int word_count)
+			: rating(rating), status(status), word_count(word_count)
+		{
+		}
+
+		std::atomic<int> rating;
+		std::atomic<DocumentStatus> status;
+		// Number of non-stop words, the document length for the scorers
+		const int word_count;
 	};
 
 	std::set<std::string, std::less<>> words_;
 
 	const std::set<std::string, std::less<>> stop_words_;
+	const IndexOptions options_;
 	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
+	// Varint coded deltas of the word positions, filled only with store_positions
+	std::map<std::string_view, std::map<int, std::string>> word_to_document_positions_;
+	// Heap bytes of the strings in word_to_document_positions_
+	uint64_t position_heap_bytes_ = 0;
 	std::map<int, std::map<std::string_view, double>, std::less<>> document_to_word_freqs_;
 	std::map<int, DocumentData> documents_;
 	std::set<int> document_ids_;
+	uint64_t total_word_count_ = 0;
+	// Null when the texts are not stored
+	std::unique_ptr<DocumentStore> content_store_;
 
 	bool IsStopWord(const std::string_view word) const
 	{
@@ -122,10 +370,15 @@ private:
 
 	static int ComputeAverageRating(const std::vector<int>& ratings);
 
+	// Throw std::out_of_range for an unknown document
+	DocumentData& GetDocumentData(int document_id);
+	const DocumentData& GetDocumentData(int document_id) const;
+
 	struct QueryWord
 	{
 		std::string_view data;
 		bool is_minus;
+		bool is_required;
 		bool is_stop;
 	};
 
@@ -135,55 +388,306 @@ private:
 	{
 		std::vector<std::string_view> plus_words;
 		std::vector<std::string_view> minus_words;
+		// "+word": a document must contain every one of them. They are plus-words too
+		std::vector<std::string_view> required_words;
+		// "several words": they must follow each other, ignoring stop words.
+		// Their words are required words too
+		std::vector<std::vector<std::string_view>> phrases;
+		// Relevance multipliers of the plus-words found by fuzzy matching only
+		std::map<std::string_view, double> word_weights;
+
+		double GetWordWeight(std::string_view word) const
+		{
+			const auto it = word_weights.find(word);
+			return it == word_weights.end() ? 1.0 : it->second;
+		}
 	};
 
 	Query ParseQuery(std::string_view text, const bool b) const;
 
-	// Existence required
-	double ComputeWordInverseDocumentFreq(const std::string_view& word) const {
-		return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-	}
+	static QueryClass ClassifyQuery(const Query& query);
 
-	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-		return FindAllDocuments(std::execution::seq, query, document_predicate);
+	// Query must be parsed with sorted unique words
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchParsedQuery(
+		const Query& query, int document_id) const;
+
+	template <typename ExecutionPolicy>
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+		ExecutionPolicy&& policy, const Query& query, const std::vector<int>& document_ids) const;
+
+	ScoringStats GetScoringStats() const {
+		return { documents_.size() * 1.0, documents_.empty() ? 0.0 : total_word_count_ * 1.0 / documents_.size() };
 	}
 
-	template <typename DocumentPredicate, typename ExecutionPolicy>
+	// Keeps the `count` best documents ranked after the cursor, in result order
+	template <typename ExecutionPolicy>
+	static void SelectTopDocuments(ExecutionPolicy&& policy, std::vector<Document>& documents,
+		const SearchAfter& after, size_t count);
+
+	template <typename Scorer, typename DocumentPredicate, typename ExecutionPolicy>
 	std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
 		DocumentPredicate document_predicate) const;
+
+	// collection, if given, supplies the statistics of a partitioned collection
+	template <typename Scorer, typename DocumentPredicate, typename ExecutionPolicy>
+	std::vector<Document> FindAllDocumentsByWord(ExecutionPolicy&& policy, const Query& query,
+		DocumentPredicate document_predicate, const CollectionStats* collection = nullptr) const;
+
+	// A plus-word of a query: its postings and term weight
+	struct WordPostings
+	{
+		const std::map<int, double>* postings = nullptr;
+		double term_weight = 0.0;
+	};
+
+	// IDF of a plus-word, over the collection if given, times its weight in the query
+	template <typename Scorer>
+	double GetTermWeight(const Scorer& scorer, const Query& query, std::string_view word,
+		const std::map<int, double>& postings, const CollectionStats* collection = nullptr) const;
+
+	// Null postings for a word without documents
+	template <typename Scorer>
+	WordPostings GetWordPostings(const Scorer& scorer, const Query& query, std::string_view word,
+		const CollectionStats* collection = nullptr) const;
+
+	// Scores the postings [first, last) of one word, calling accumulate(document_id, score)
+	// for each document the predicate accepts. Every scoring path goes through here
+	template <typename Scorer, typename DocumentPredicate, typename Accumulate>
+	void ScorePostings(const Scorer& scorer, double term_weight,
+		std::map<int, double>::const_iterator first, std::map<int, double>::const_iterator last,
+		DocumentPredicate& document_predicate, Accumulate accumulate) const;
+
+	// Drops the documents of a minus-word, walking whichever side is shorter
+	static void EraseDocuments(const std::map<int, double>& postings, std::map<int, double>& document_to_relevance);
+
+	size_t GetLongestPostingList(const std::vector<std::string_view>& words) const;
+
+	// Ids of the documents containing every required word and every phrase of the query
+	std::vector<int> IntersectRequiredWords(const Query& query) const;
+
+	bool ContainsPhrase(const std::vector<std::string_view>& phrase, int document_id) const;
+
+	// Appends the expansion of "prefix*" keeping the max_words most frequent words,
+	// chosen in one pass over the dictionary range of the prefix
+	void ExpandPrefix(std::string_view prefix, size_t max_words, std::vector<std::string_view>& words) const;
+
+	// Dictionary words within max_distance edits of word with their distances,
+	// found by walking a Levenshtein automaton over the sorted dictionary
+	std::vector<std::pair<std::string_view, int>> FindFuzzyWords(std::string_view word, int max_distance) const;
+
+	// Counts the work of a query against its QueryBudget
+	class BudgetTracker
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		explicit BudgetTracker(const QueryBudget& budget);
+
+		// Takes postings from the budget, false once it is exhausted.
+		// Refused postings are not charged, so every charged one gets scored
+		bool Charge(size_t postings);
+		bool CheckDeadline();
+		bool IsExhausted() const { return exhausted_; }
+		size_t GetPostingsCharged() const { return postings_charged_; }
+
+	private:
+		const size_t max_postings_;
+		const bool has_deadline_;
+		const Clock::time_point deadline_;
+		size_t postings_charged_ = 0;
+		size_t postings_since_clock_ = 0;
+		bool exhausted_ = false;
+	};
+
+	// Scores only the documents that contain all the required words,
+	// stopping early if the budget runs out
+	template <typename Scorer, typename DocumentPredicate>
+	std::vector<Document> FindAllDocumentsConjunctive(const Query& query,
+		DocumentPredicate document_predicate, BudgetTracker* budget = nullptr,
+		const CollectionStats* collection = nullptr) const;
+
+	// Sequential scoring, rarest plus-word first, until the budget runs out
+	template <typename Scorer, typename DocumentPredicate>
+	std::vector<Document> FindAllDocumentsWithinBudget(const Query& query,
+		DocumentPredicate document_predicate, BudgetTracker& budget) const;
+
+	enum class ExecutionMode
+	{
+		SEQUENTIAL,
+		PARALLEL,
+		BLOCKED,
+	};
+
+	ExecutionMode ChooseExecutionMode(const Query& query) const;
+
+	static ExecutionThresholds MeasureExecutionThresholds();
+
+	// Splits the document id space into blocks and scores every block on its own
+	// thread, so even a single hot word keeps all cores busy
+	template <typename Scorer, typename DocumentPredicate>
+	std::vector<Document> FindAllDocumentsBlocked(const Query& query,
+		DocumentPredicate document_predicate) const;
 };
 
 template<typename StringContainer>
-inline SearchServer::SearchServer(const StringContainer& stop_words) :
-	stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+inline SearchServer::SearchServer(const StringContainer& stop_words, IndexOptions options) :
+	stop_words_(MakeUniqueNonEmptyStrings(stop_words)), options_(options)
 {
+	if (options_.store_content)
+	{
+		content_store_ = std::make_unique<DocumentStore>(options_.content_block_size, options_.content_spill_path);
+	}
 	if (!std::all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
 		throw std::invalid_argument("Some of stop words are invalid"s);
 	}
+	CalibrateExecution();
 }
 
 template<typename DocumentPredicate, typename ExecutionPolicy>
 inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const
 {
-	const auto query = ParseQuery(raw_query, true);
+	return FindTopDocuments(policy, raw_query, document_predicate, SearchAfter{}, MAX_RESULT_DOCUMENT_COUNT);
+}
 
-	auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template<typename DocumentPredicate, typename ExecutionPolicy>
+inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+	DocumentPredicate document_predicate, const SearchAfter& after, size_t page_size) const
+{
+	return FindTopDocuments<TfIdfScorer>(policy, raw_query, document_predicate, after, page_size);
+}
 
-	std::sort(
-		policy,
-		matched_documents.begin(), matched_documents.end(),
-		[](const Document& lhs, const Document& rhs) {
-			return lhs.relevance > rhs.relevance
-			|| (std::abs(lhs.relevance - rhs.relevance) < EPSILON && lhs.rating > rhs.rating);
-		});
+template<typename Scorer, typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+	DocumentPredicate document_predicate, const SearchAfter& after, size_t page_size) const
+{
+	if constexpr (std::is_same_v<DocumentPredicate, DocumentStatus>)
+	{
+		return FindTopDocuments<Scorer>(policy, raw_query,
+			[status = document_predicate](int document_id, DocumentStatus document_status, int rating)
+			{
+				return document_status == status;
+			},
+			after, page_size);
+	}
+	else
+	{
+		QUERY_STAGE_TIMER(QueryStage::QUERY);
+
+		const auto query = [&]
+		{
+			QUERY_STAGE_TIMER(QueryStage::PARSE);
+			return ParseQuery(raw_query, true);
+		}();
+		QUERY_CLASSIFY(ClassifyQuery(query));
+
+		auto matched_documents = FindAllDocuments<Scorer>(policy, query, document_predicate);
+
+		QUERY_STAGE_TIMER(QueryStage::TOP_K_SORT);
+		if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, AdaptiveExecutionPolicy>)
+		{
+			if (matched_documents.size() >= GetExecutionThresholds().parallel_min_postings)
+			{
+				SelectTopDocuments(std::execution::par, matched_documents, after, page_size);
+			}
+			else
+			{
+				SelectTopDocuments(std::execution::seq, matched_documents, after, page_size);
+			}
+		}
+		else
+		{
+			SelectTopDocuments(policy, matched_documents, after, page_size);
+		}
+		return matched_documents;
+	}
+}
+
+template<typename Scorer, typename DocumentPredicate>
+SearchResult SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+	const QueryBudget& budget) const
+{
+	if constexpr (std::is_same_v<DocumentPredicate, DocumentStatus>)
+	{
+		return FindTopDocuments<Scorer>(raw_query,
+			[status = document_predicate](int document_id, DocumentStatus document_status, int rating)
+			{
+				return document_status == status;
+			},
+			budget);
+	}
+	else
+	{
+		QUERY_STAGE_TIMER(QueryStage::QUERY);
+		BudgetTracker tracker(budget);
+
+		const auto query = [&]
+		{
+			QUERY_STAGE_TIMER(QueryStage::PARSE);
+			return ParseQuery(raw_query, true);
+		}();
+		QUERY_CLASSIFY(ClassifyQuery(query));
+
+		SearchResult result;
+		if (tracker.CheckDeadline())
+		{
+			result.documents = FindAllDocumentsWithinBudget<Scorer>(query, document_predicate, tracker);
+		}
+		result.is_partial = tracker.IsExhausted();
+		QUERY_COUNTER_ADD(QueryCounter::PARTIAL_RESULTS, result.is_partial ? 1 : 0);
 
-	if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-		matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+		QUERY_STAGE_TIMER(QueryStage::TOP_K_SORT);
+		SelectTopDocuments(std::execution::seq, result.documents, SearchAfter{}, MAX_RESULT_DOCUMENT_COUNT);
+		return result;
 	}
+}
+
+template<typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+	const CollectionStats& collection, size_t count) const
+{
+	QUERY_STAGE_TIMER(QueryStage::QUERY);
+
+	const auto query = [&]
+	{
+		QUERY_STAGE_TIMER(QueryStage::PARSE);
+		return ParseQuery(raw_query, true);
+	}();
+	QUERY_CLASSIFY(ClassifyQuery(query));
+
+	const auto document_predicate = [status](int document_id, DocumentStatus document_status, int rating)
+	{
+		return document_status == status;
+	};
+	std::vector<Document> matched_documents = query.required_words.empty()
+		? FindAllDocumentsByWord<Scorer>(std::execution::seq, query, document_predicate, &collection)
+		: FindAllDocumentsConjunctive<Scorer>(query, document_predicate, nullptr, &collection);
+
+	QUERY_STAGE_TIMER(QueryStage::TOP_K_SORT);
+	SelectTopDocuments(std::execution::seq, matched_documents, SearchAfter{}, count);
 	return matched_documents;
 }
 
+template<typename ExecutionPolicy>
+void SearchServer::SelectTopDocuments(ExecutionPolicy&& policy, std::vector<Document>& documents,
+	const SearchAfter& after, size_t count)
+{
+	const Document last{ after.id, after.relevance, after.rating };
+	documents.erase(
+		std::remove_if(
+			policy,
+			documents.begin(), documents.end(),
+			[&last](const Document& document)
+			{ return !IsRankedHigher(last, document); }),
+		documents.end());
+
+	const size_t page_size = std::min(count, documents.size());
+	std::partial_sort(
+		policy,
+		documents.begin(), documents.begin() + page_size, documents.end(),
+		IsRankedHigher);
+	documents.resize(page_size);
+}
+
 template<class ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id)
 {
@@ -191,6 +695,7 @@ void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id)
 	{
 		return;
 	}
+	QUERY_STAGE_TIMER(QueryStage::REMOVE_DOCUMENT);
 
 	const auto& word_freqs = document_to_word_freqs_.at(document_id);
 	std::vector<const std::string_view*> words(word_freqs.size());
@@ -207,55 +712,627 @@ void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id)
 		[this, document_id](const auto* ptr)
 		{ word_to_document_freqs_.at(*ptr).erase(document_id); });
 
+	total_word_count_ -= documents_.at(document_id).word_count;
+	if (options_.store_positions)
+	{
+		for (const auto* ptr : words)
+		{
+			auto& document_positions = word_to_document_positions_.at(*ptr);
+			const auto it = document_positions.find(document_id);
+			if (it != document_positions.end())
+			{
+				position_heap_bytes_ -= StringHeapBytes(it->second);
+				document_positions.erase(it);
+			}
+		}
+	}
+
+	if (content_store_)
+	{
+		content_store_->Remove(document_id);
+	}
 	documents_.erase(document_id);
 	document_to_word_freqs_.erase(document_id);
 	document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
 }
 
-template<typename DocumentPredicate, typename ExecutionPolicy>
+template<typename ExecutionPolicy>
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+	ExecutionPolicy&& policy, const Query& query, const std::vector<int>& document_ids) const
+{
+	for (const int document_id : document_ids)
+	{
+		if (documents_.count(document_id) == 0)
+		{
+			throw std::out_of_range("Invalid document_id");
+		}
+	}
+
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> result(document_ids.size());
+	std::transform(
+		policy,
+		document_ids.begin(), document_ids.end(),
+		result.begin(),
+		[this, &query](int document_id)
+		{ return MatchParsedQuery(query, document_id); });
+	return result;
+}
+
+template<typename Scorer, typename DocumentPredicate, typename ExecutionPolicy>
 inline std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const
+{
+	if (!query.required_words.empty())
+	{
+		return FindAllDocumentsConjunctive<Scorer>(query, document_predicate);
+	}
+
+	if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, AdaptiveExecutionPolicy>)
+	{
+		switch (ChooseExecutionMode(query))
+		{
+		case ExecutionMode::BLOCKED:
+			return FindAllDocumentsBlocked<Scorer>(query, document_predicate);
+		case ExecutionMode::PARALLEL:
+			return FindAllDocumentsByWord<Scorer>(std::execution::par, query, document_predicate);
+		default:
+			return FindAllDocumentsByWord<Scorer>(std::execution::seq, query, document_predicate);
+		}
+	}
+	else
+	{
+		if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>)
+		{
+			if (GetLongestPostingList(query.plus_words) >= BLOCKED_SCORING_MIN_POSTINGS)
+			{
+				return FindAllDocumentsBlocked<Scorer>(query, document_predicate);
+			}
+		}
+		return FindAllDocumentsByWord<Scorer>(policy, query, document_predicate);
+	}
+}
+
+template<typename Scorer, typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindAllDocumentsByWord(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate,
+	const CollectionStats* collection) const
 {
 	ConcurrentMap<int, double> cm_document_to_relevance(100);
+	const Scorer scorer(collection != nullptr ? collection->GetScoringStats() : GetScoringStats());
 
 	std::for_each(
 		policy,
 		query.plus_words.begin(), query.plus_words.end(),
-		[this, &document_predicate, &cm_document_to_relevance](std::string_view word)
+		[this, &query, &scorer, &document_predicate, &cm_document_to_relevance, collection](std::string_view word)
 		{
-			if (word_to_document_freqs_.count(word) == 0)
+			const WordPostings word_postings = [&]
+			{
+				QUERY_STAGE_TIMER(QueryStage::POSTING_FETCH);
+				return GetWordPostings(scorer, query, word, collection);
+			}();
+			if (word_postings.postings == nullptr)
 			{
 				return;
 			}
 
-	const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-	for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word))
+			QUERY_STAGE_TIMER(QueryStage::SCORE);
+			QUERY_COUNTER_ADD(QueryCounter::POSTINGS_SCANNED, word_postings.postings->size());
+			ScorePostings(scorer, word_postings.term_weight, word_postings.postings->begin(), word_postings.postings->end(),
+				document_predicate,
+				[&cm_document_to_relevance](int document_id, double score)
+				{
+					cm_document_to_relevance[document_id].ref_to_value += score;
+				});
+		}
+	);
+
+	std::map<int, double> document_to_relevance(cm_document_to_relevance.BuildOrdinaryMap());
+
 	{
+		QUERY_STAGE_TIMER(QueryStage::MINUS_FILTER);
+		for (std::string_view word : query.minus_words)
+		{
+			const auto it = word_to_document_freqs_.find(word);
+			if (it != word_to_document_freqs_.end())
+			{
+				EraseDocuments(it->second, document_to_relevance);
+			}
+		}
+	}
+	QUERY_COUNTER_ADD(QueryCounter::DOCUMENTS_MATCHED, document_to_relevance.size());
 
+	std::vector<Document> matched_documents;
+	for (const auto& [document_id, relevance] : document_to_relevance)
+	{
+		matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating.load(std::memory_order_relaxed) });
+	}
+	return matched_documents;
+} 
+
+template<typename Scorer>
+double SearchServer::GetTermWeight(const Scorer& scorer, const Query& query, std::string_view word,
+	const std::map<int, double>& postings, const CollectionStats* collection) const
+{
+	uint64_t document_freq = postings.size();
+	if (collection != nullptr)
+	{
+		// A word missing from the statistics counts with its local frequency
+		const auto it = collection->document_freqs.find(word);
+		if (it != collection->document_freqs.end())
+		{
+			document_freq = std::max(document_freq, it->second);
+		}
+	}
+	return scorer.TermWeight(document_freq) * query.GetWordWeight(word);
+}
+
+template<typename Scorer>
+SearchServer::WordPostings SearchServer::GetWordPostings(const Scorer& scorer, const Query& query, std::string_view word,
+	const CollectionStats* collection) const
+{
+	const auto it = word_to_document_freqs_.find(word);
+	if (it == word_to_document_freqs_.end() || it->second.empty())
+	{
+		return {};
+	}
+	return { &it->second, GetTermWeight(scorer, query, word, it->second, collection) };
+}
+
+template<typename Scorer, typename DocumentPredicate, typename Accumulate>
+void SearchServer::ScorePostings(const Scorer& scorer, double term_weight,
+	std::map<int, double>::const_iterator first, std::map<int, double>::const_iterator last,
+	DocumentPredicate& document_predicate, Accumulate accumulate) const
+{
+	for (; first != last; ++first)
+	{
+		const auto& [document_id, term_freq] = *first;
 		const auto& document_data = documents_.at(document_id);
-		if (document_predicate(document_id, document_data.status, document_data.rating))
+		if (document_predicate(document_id, document_data.status.load(std::memory_order_relaxed),
+			document_data.rating.load(std::memory_order_relaxed)))
 		{
-			cm_document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+			accumulate(document_id, scorer.Score(term_weight, term_freq, document_data.word_count));
 		}
 	}
+}
+
+template<typename Scorer, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocumentsBlocked(const Query& query, DocumentPredicate document_predicate) const
+{
+	if (document_ids_.empty())
+	{
+		return {};
+	}
+
+	const Scorer scorer(GetScoringStats());
+	std::vector<WordPostings> plus_postings;
+	std::vector<const std::map<int, double>*> minus_postings;
+	size_t total_postings = 0;
+	{
+		QUERY_STAGE_TIMER(QueryStage::POSTING_FETCH);
+		for (std::string_view word : query.plus_words)
+		{
+			const WordPostings word_postings = GetWordPostings(scorer, query, word);
+			if (word_postings.postings != nullptr)
+			{
+				plus_postings.push_back(word_postings);
+				total_postings += word_postings.postings->size();
+			}
 		}
-	);
+		for (std::string_view word : query.minus_words)
+		{
+			const auto it = word_to_document_freqs_.find(word);
+			if (it != word_to_document_freqs_.end() && !it->second.empty())
+			{
+				minus_postings.push_back(&it->second);
+			}
+		}
+	}
+	QUERY_COUNTER_ADD(QueryCounter::POSTINGS_SCANNED, total_postings);
 
-	std::map<int, double> document_to_relevance(cm_document_to_relevance.BuildOrdinaryMap());
+	const int64_t min_id = *document_ids_.begin();
+	const int64_t id_span = static_cast<int64_t>(*document_ids_.rbegin()) - min_id + 1;
+	const int64_t block_count = static_cast<int64_t>(
+		std::clamp<size_t>(total_postings / SCORING_BLOCK_SIZE, 1, MAX_SCORING_BLOCKS));
+
+	std::vector<std::vector<Document>> block_documents(block_count);
+	std::vector<int64_t> blocks(block_count);
+	std::iota(blocks.begin(), blocks.end(), 0);
+
+	{
+		QUERY_STAGE_TIMER(QueryStage::SCORE);
+		std::for_each(
+			std::execution::par,
+			blocks.begin(), blocks.end(),
+			[&](int64_t block)
+			{
+				const int first_id = static_cast<int>(min_id + id_span * block / block_count);
+				const int64_t last_id = min_id + id_span * (block + 1) / block_count;
+				auto block_end = [&](const std::map<int, double>* postings)
+				{
+					return block + 1 == block_count ? postings->end() : postings->lower_bound(static_cast<int>(last_id));
+				};
+
+				std::vector<std::pair<int, double>> relevances;
+				for (const auto& [postings, term_weight] : plus_postings)
+				{
+					ScorePostings(scorer, term_weight, postings->lower_bound(first_id), block_end(postings), document_predicate,
+						[&relevances](int document_id, double score) { relevances.emplace_back(document_id, score); });
+				}
+
+				// Each posting list is already ordered by id, so only several words need merging
+				if (plus_postings.size() > 1)
+				{
+					std::stable_sort(relevances.begin(), relevances.end(),
+						[](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+				}
+
+				QUERY_STAGE_TIMER(QueryStage::MINUS_FILTER);
+				std::vector<int> excluded_ids;
+				for (const auto* postings : minus_postings)
+				{
+					const auto end = block_end(postings);
+					for (auto it = postings->lower_bound(first_id); it != end; ++it)
+					{
+						excluded_ids.push_back(it->first);
+					}
+				}
+				std::sort(excluded_ids.begin(), excluded_ids.end());
+
+				auto& documents = block_documents[block];
+				for (size_t i = 0; i < relevances.size();)
+				{
+					const int document_id = relevances[i].first;
+					double relevance = 0.0;
+					for (; i < relevances.size() && relevances[i].first == document_id; ++i)
+					{
+						relevance += relevances[i].second;
+					}
+					if (!std::binary_search(excluded_ids.begin(), excluded_ids.end(), document_id))
+					{
+						documents.push_back({ document_id, relevance, documents_.at(document_id).rating.load(std::memory_order_relaxed) });
+					}
+				}
+			});
+	}
 
-	for (const std::string_view& word : query.minus_words)
+	std::vector<Document> matched_documents;
+	for (auto& documents : block_documents)
 	{
-		if (word_to_document_freqs_.count(word) == 0) {
+		matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+	}
+	QUERY_COUNTER_ADD(QueryCounter::DOCUMENTS_MATCHED, matched_documents.size());
+	return matched_documents;
+}
+
+template<typename Scorer, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocumentsConjunctive(const Query& query, DocumentPredicate document_predicate,
+	BudgetTracker* budget, const CollectionStats* collection) const
+{
+	const std::vector<int> candidates = [&]
+	{
+		QUERY_STAGE_TIMER(QueryStage::POSTING_FETCH);
+		return IntersectRequiredWords(query);
+	}();
+
+	const Scorer scorer(collection != nullptr ? collection->GetScoringStats() : GetScoringStats());
+	std::vector<WordPostings> plus_postings;
+	for (std::string_view word : query.plus_words)
+	{
+		const WordPostings word_postings = GetWordPostings(scorer, query, word, collection);
+		if (word_postings.postings != nullptr)
+		{
+			plus_postings.push_back(word_postings);
+		}
+	}
+
+	std::vector<Document> matched_documents;
+	QUERY_STAGE_TIMER(QueryStage::SCORE);
+	QUERY_COUNTER_ADD(QueryCounter::POSTINGS_SCANNED, candidates.size() * plus_postings.size());
+	for (const int document_id : candidates)
+	{
+		if (budget != nullptr && !budget->Charge(plus_postings.size()))
+		{
+			break;
+		}
+		const bool has_minus_word = std::any_of(
+			query.minus_words.begin(), query.minus_words.end(),
+			[this, document_id](std::string_view word)
+			{
+				const auto it = word_to_document_freqs_.find(word);
+				return it != word_to_document_freqs_.end() && it->second.count(document_id) > 0;
+			});
+		if (has_minus_word)
+		{
 			continue;
 		}
-		for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-			document_to_relevance.erase(document_id);
+
+		// A candidate has a posting of every required word, so it is scored
+		// exactly when the predicate accepts it
+		std::optional<double> relevance;
+		for (const auto& [postings, term_weight] : plus_postings)
+		{
+			const auto it = postings->find(document_id);
+			if (it != postings->end())
+			{
+				ScorePostings(scorer, term_weight, it, std::next(it), document_predicate,
+					[&relevance](int, double score) { relevance = relevance.value_or(0.0) + score; });
+			}
+		}
+		if (relevance)
+		{
+			matched_documents.push_back({ document_id, *relevance, documents_.at(document_id).rating.load(std::memory_order_relaxed) });
+		}
+	}
+	QUERY_COUNTER_ADD(QueryCounter::DOCUMENTS_MATCHED, matched_documents.size());
+	return matched_documents;
+}
+
+template<typename Scorer, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocumentsWithinBudget(const Query& query, DocumentPredicate document_predicate,
+	BudgetTracker& budget) const
+{
+	if (!query.required_words.empty())
+	{
+		return FindAllDocumentsConjunctive<Scorer>(query, document_predicate, &budget);
+	}
+
+	const Scorer scorer(GetScoringStats());
+	std::vector<WordPostings> plus_postings;
+	{
+		QUERY_STAGE_TIMER(QueryStage::POSTING_FETCH);
+		for (std::string_view word : query.plus_words)
+		{
+			const WordPostings word_postings = GetWordPostings(scorer, query, word);
+			if (word_postings.postings != nullptr)
+			{
+				plus_postings.push_back(word_postings);
+			}
+		}
+		std::sort(plus_postings.begin(), plus_postings.end(),
+			[](const WordPostings& lhs, const WordPostings& rhs)
+			{ return lhs.postings->size() < rhs.postings->size(); });
+	}
+
+	std::map<int, double> document_to_relevance;
+	{
+		QUERY_STAGE_TIMER(QueryStage::SCORE);
+		for (const auto& [postings, term_weight] : plus_postings)
+		{
+			// Charged a posting at a time, scored a clock interval at a time
+			for (auto first = postings->begin(); first != postings->end() && !budget.IsExhausted();)
+			{
+				auto last = first;
+				for (size_t charged = 0; last != postings->end() && charged < BUDGET_CLOCK_INTERVAL && budget.Charge(1); ++charged)
+				{
+					++last;
+				}
+				ScorePostings(scorer, term_weight, first, last, document_predicate,
+					[&document_to_relevance](int document_id, double score) { document_to_relevance[document_id] += score; });
+				first = last;
+			}
+			if (budget.IsExhausted())
+			{
+				break;
+			}
 		}
+		QUERY_COUNTER_ADD(QueryCounter::POSTINGS_SCANNED, budget.GetPostingsCharged());
 	}
 
+	{
+		// Minus-words are never cut short: walk whichever side is shorter
+		QUERY_STAGE_TIMER(QueryStage::MINUS_FILTER);
+		for (std::string_view word : query.minus_words)
+		{
+			const auto it = word_to_document_freqs_.find(word);
+			if (it != word_to_document_freqs_.end())
+			{
+				EraseDocuments(it->second, document_to_relevance);
+			}
+		}
+	}
+	QUERY_COUNTER_ADD(QueryCounter::DOCUMENTS_MATCHED, document_to_relevance.size());
+
 	std::vector<Document> matched_documents;
+	matched_documents.reserve(document_to_relevance.size());
 	for (const auto& [document_id, relevance] : document_to_relevance)
 	{
-		matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+		matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating.load(std::memory_order_relaxed) });
 	}
 	return matched_documents;
-} 
+}
+
+template<typename Scorer, typename ExecutionPolicy>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(ExecutionPolicy&& policy,
+	const std::vector<std::string>& raw_queries, DocumentStatus status) const
+{
+	std::vector<Query> queries(raw_queries.size());
+	std::transform(
+		policy,
+		raw_queries.begin(), raw_queries.end(),
+		queries.begin(),
+		[this](const std::string& raw_query) { return ParseQuery(raw_query, true); });
+
+	const auto document_predicate = [status](int document_id, DocumentStatus document_status, int rating)
+	{
+		return document_status == status;
+	};
+	std::vector<std::vector<Document>> results(queries.size());
+
+	// A word traversed once for the queries using it with the same weight,
+	// numbered by their position in `batched`
+	struct BatchTerm
+	{
+		WordPostings word;
+		std::vector<size_t> queries;
+	};
+
+	const Scorer scorer(GetScoringStats());
+	std::vector<size_t> batched;
+	std::vector<size_t> conjunctive;
+	std::map<std::pair<std::string_view, double>, size_t> plus_term_indexes;
+	std::vector<BatchTerm> plus_terms;
+	std::map<std::string_view, size_t> minus_term_indexes;
+	std::vector<const std::map<int, double>*> minus_terms;
+	std::vector<std::vector<size_t>> query_minus_terms;
+	size_t total_postings = 0;
+
+	for (size_t i = 0; i < queries.size(); ++i)
+	{
+		const Query& query = queries[i];
+		if (!query.required_words.empty())
+		{
+			conjunctive.push_back(i);
+			continue;
+		}
+		const size_t batch_index = batched.size();
+		batched.push_back(i);
+
+		for (std::string_view word : query.plus_words)
+		{
+			const WordPostings word_postings = GetWordPostings(scorer, query, word);
+			if (word_postings.postings == nullptr)
+			{
+				continue;
+			}
+			const auto [term_it, inserted] = plus_term_indexes.emplace(
+				std::pair{ word, query.GetWordWeight(word) }, plus_terms.size());
+			if (inserted)
+			{
+				plus_terms.push_back({ word_postings, {} });
+				total_postings += word_postings.postings->size();
+			}
+			plus_terms[term_it->second].queries.push_back(batch_index);
+		}
+
+		query_minus_terms.emplace_back();
+		for (std::string_view word : query.minus_words)
+		{
+			const auto it = word_to_document_freqs_.find(word);
+			if (it == word_to_document_freqs_.end() || it->second.empty())
+			{
+				continue;
+			}
+			const auto [term_it, inserted] = minus_term_indexes.emplace(word, minus_terms.size());
+			if (inserted)
+			{
+				minus_terms.push_back(&it->second);
+			}
+			query_minus_terms.back().push_back(term_it->second);
+		}
+	}
+	QUERY_COUNTER_ADD(QueryCounter::POSTINGS_SCANNED, total_postings);
+
+	std::for_each(
+		policy,
+		conjunctive.begin(), conjunctive.end(),
+		[&](size_t i)
+		{
+			results[i] = FindAllDocumentsConjunctive<Scorer>(queries[i], document_predicate);
+			SelectTopDocuments(std::execution::seq, results[i], SearchAfter{}, MAX_RESULT_DOCUMENT_COUNT);
+		});
+
+	if (plus_terms.empty())
+	{
+		return results;
+	}
+
+	const int64_t min_id = *document_ids_.begin();
+	const int64_t id_span = static_cast<int64_t>(*document_ids_.rbegin()) - min_id + 1;
+	const int64_t block_count = static_cast<int64_t>(
+		std::clamp<size_t>(total_postings / SCORING_BLOCK_SIZE, 1, MAX_SCORING_BLOCKS));
+
+	// Best documents of every query within every block
+	std::vector<std::vector<std::pair<size_t, std::vector<Document>>>> block_results(block_count);
+	std::vector<int64_t> blocks(block_count);
+	std::iota(blocks.begin(), blocks.end(), 0);
+
+	std::for_each(
+		policy,
+		blocks.begin(), blocks.end(),
+		[&](int64_t block)
+		{
+			const int first_id = static_cast<int>(min_id + id_span * block / block_count);
+			const int64_t last_id = min_id + id_span * (block + 1) / block_count;
+			auto block_end = [&](const std::map<int, double>* postings)
+			{
+				return block + 1 == block_count ? postings->end() : postings->lower_bound(static_cast<int>(last_id));
+			};
+
+			std::vector<std::vector<std::pair<int, double>>> relevances(batched.size());
+			std::vector<size_t> touched;
+			for (const BatchTerm& term : plus_terms)
+			{
+				const auto& [postings, term_weight] = term.word;
+				ScorePostings(scorer, term_weight, postings->lower_bound(first_id), block_end(postings), document_predicate,
+					[&](int document_id, double score)
+					{
+						for (const size_t query : term.queries)
+						{
+							auto& query_relevances = relevances[query];
+							if (query_relevances.empty())
+							{
+								touched.push_back(query);
+							}
+							query_relevances.emplace_back(document_id, score);
+						}
+					});
+			}
+
+			std::vector<std::vector<int>> excluded_ids(minus_terms.size());
+			for (size_t i = 0; i < minus_terms.size(); ++i)
+			{
+				const auto end = block_end(minus_terms[i]);
+				for (auto it = minus_terms[i]->lower_bound(first_id); it != end; ++it)
+				{
+					excluded_ids[i].push_back(it->first);
+				}
+			}
+
+			for (const size_t query : touched)
+			{
+				auto& query_relevances = relevances[query];
+				// Runs of one word are ordered by id already
+				std::stable_sort(query_relevances.begin(), query_relevances.end(),
+					[](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+				std::vector<Document> documents;
+				for (size_t i = 0; i < query_relevances.size();)
+				{
+					const int document_id = query_relevances[i].first;
+					double relevance = 0.0;
+					for (; i < query_relevances.size() && query_relevances[i].first == document_id; ++i)
+					{
+						relevance += query_relevances[i].second;
+					}
+					const bool has_minus_word = std::any_of(
+						query_minus_terms[query].begin(), query_minus_terms[query].end(),
+						[&excluded_ids, document_id](size_t term)
+						{
+							return std::binary_search(excluded_ids[term].begin(), excluded_ids[term].end(), document_id);
+						});
+					if (!has_minus_word)
+					{
+						documents.push_back({ document_id, relevance,
+							documents_.at(document_id).rating.load(std::memory_order_relaxed) });
+					}
+				}
+				SelectTopDocuments(std::execution::seq, documents, SearchAfter{}, MAX_RESULT_DOCUMENT_COUNT);
+				block_results[block].emplace_back(query, std::move(documents));
+			}
+		});
+
+	for (auto& block : block_results)
+	{
+		for (auto& [query, documents] : block)
+		{
+			auto& result = results[batched[query]];
+			result.insert(result.end(), documents.begin(), documents.end());
+		}
+	}
+	std::for_each(
+		policy,
+		batched.begin(), batched.end(),
+		[&results](size_t i)
+		{
+			SelectTopDocuments(std::execution::seq, results[i], SearchAfter{}, MAX_RESULT_DOCUMENT_COUNT);
+		});
+	return results;
+}
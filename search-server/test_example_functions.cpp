@@ -17,5 +17,253 @@ void AssertImpl(bool value, const string& expr_str, const string& file, const st
     }
 }
 
+namespace {
+
+// Ids of the documents, in the order they were returned
+vector<int> GetIds(const vector<Document>& documents) {
+    vector<int> ids;
+    for (const Document& document : documents) {
+        ids.push_back(document.id);
+    }
+    return ids;
+}
+
+} // namespace
+
+void TestSearchAfterPagesThroughTies() {
+    SearchServer server(""s);
+    // Ten documents tie on relevance and rating, two rank above them
+    for (int id = 0; id < 10; ++id) {
+        server.AddDocument(id, "white cat"s, DocumentStatus::ACTUAL, { 3 });
+    }
+    server.AddDocument(10, "white cat cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(11, "white cat"s, DocumentStatus::ACTUAL, { 5 });
+    server.AddDocument(12, "black dog"s, DocumentStatus::ACTUAL, { 3 });
+
+    const vector<int> all_ids = GetIds(server.FindTopDocuments("cat"s, SearchAfter{}, 100));
+    ASSERT_EQUAL(all_ids, (vector<int>{ 10, 11, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }));
+
+    for (size_t page_size : { 1, 2, 5 }) {
+        vector<int> paged_ids;
+        SearchAfter after;
+        while (true) {
+            const vector<Document> page = server.FindTopDocuments(execution::par, "cat"s,
+                DocumentStatus::ACTUAL, after, page_size);
+            if (page.empty()) {
+                break;
+            }
+            ASSERT(page.size() <= page_size);
+            for (const int id : GetIds(page)) {
+                paged_ids.push_back(id);
+            }
+            after = SearchAfter(page.back());
+        }
+        ASSERT_EQUAL_HINT(paged_ids, all_ids, "page size "s + to_string(page_size));
+    }
+}
+
+void TestRequiredWordsFilterDocuments() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "dog bird"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "dog"s, DocumentStatus::ACTUAL, { 4 });
+
+    auto sorted_ids = [&server](const string& query) {
+        vector<int> ids = GetIds(server.FindTopDocuments(query));
+        const vector<int> parallel_ids = GetIds(server.FindTopDocuments(execution::par, query));
+        ASSERT_EQUAL_HINT(parallel_ids, ids, query);
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    ASSERT_EQUAL(sorted_ids("+cat dog"s), (vector<int>{ 1, 2 }));
+    ASSERT_EQUAL(sorted_ids("+cat +bird"s), (vector<int>{ 2 }));
+    ASSERT_EQUAL(sorted_ids("+dog bird -cat"s), (vector<int>{ 3, 4 }));
+    ASSERT_EQUAL(sorted_ids("+cat +fish"s), vector<int>{});
+    // A required stop word requires nothing
+    ASSERT_EQUAL(sorted_ids("+and cat"s), (vector<int>{ 1, 2 }));
+    // The plain words still rank the documents that pass
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("+cat bird"s)).front(), 2);
+}
+
+void TestPhraseQueries() {
+    IndexOptions options;
+    options.store_positions = true;
+    SearchServer server("and the"s, options);
+    server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "yellow cat white hat"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "white fluffy cat"s, DocumentStatus::ACTUAL, { 3 });
+
+    auto sorted_ids = [&server](const string& query) {
+        vector<int> ids = GetIds(server.FindTopDocuments(query));
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    ASSERT_EQUAL(sorted_ids("\"white cat\""s), (vector<int>{ 1 }));
+    ASSERT_EQUAL(sorted_ids("\"cat white\""s), (vector<int>{ 2 }));
+    ASSERT_EQUAL(sorted_ids("\"cat white hat\""s), (vector<int>{ 2 }));
+    ASSERT_EQUAL(sorted_ids("\"white hat\" -yellow"s), vector<int>{});
+    // The removed stop word leaves "cat" and "yellow" adjacent
+    ASSERT_EQUAL(sorted_ids("\"cat yellow\""s), (vector<int>{ 1 }));
+    ASSERT_EQUAL(sorted_ids("\"cat and yellow\""s), (vector<int>{ 1 }));
+    ASSERT_EQUAL(sorted_ids("\"cat the yellow\""s), (vector<int>{ 1 }));
+    // Quotes standing apart from the words
+    ASSERT_EQUAL(sorted_ids("\" white cat \""s), (vector<int>{ 1 }));
+    // A single word phrase is a required word
+    ASSERT_EQUAL(sorted_ids("\"fluffy\" white"s), (vector<int>{ 3 }));
+
+    for (const string& query : { "\""s, "\"\""s, "cat \" \""s, "\"white cat"s }) {
+        try {
+            server.FindTopDocuments(query);
+            ASSERT_HINT(false, query);
+        } catch (const invalid_argument& e) {
+            ASSERT_EQUAL_HINT(string(e.what()), "Unbalanced or empty phrase"s, query);
+        }
+    }
+
+    SearchServer no_positions(""s);
+    no_positions.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    try {
+        no_positions.FindTopDocuments("\"white cat\""s);
+        ASSERT(false);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestPrefixQueries() {
+    {
+        SearchServer server(""s);
+        server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        server.AddDocument(2, "car"s, DocumentStatus::ACTUAL, { 2 });
+        server.AddDocument(3, "cart wheel"s, DocumentStatus::ACTUAL, { 3 });
+        server.AddDocument(4, "dog wheel"s, DocumentStatus::ACTUAL, { 4 });
+
+        auto sorted_ids = [&server](const string& query) {
+            vector<int> ids = GetIds(server.FindTopDocuments(query));
+            sort(ids.begin(), ids.end());
+            return ids;
+        };
+        ASSERT_EQUAL(sorted_ids("ca*"s), (vector<int>{ 1, 2, 3 }));
+        ASSERT_EQUAL(sorted_ids("car*"s), (vector<int>{ 2, 3 }));
+        ASSERT_EQUAL(sorted_ids("wheel -car*"s), (vector<int>{ 4 }));
+        ASSERT_EQUAL(sorted_ids("x*"s), vector<int>{});
+        // A lone "*" is a plain word
+        ASSERT_EQUAL(sorted_ids("*"s), vector<int>{});
+    }
+
+    // More words than the cap: each is in one document, the first ten in a second one too
+    const int word_count = static_cast<int>(MAX_PREFIX_EXPANSIONS) + 10;
+    SearchServer server(""s);
+    for (int i = 0; i < word_count; ++i) {
+        server.AddDocument(i, "x p"s + to_string(i), DocumentStatus::ACTUAL, { 1 });
+    }
+    for (int i = 0; i < 10; ++i) {
+        server.AddDocument(word_count + i, "x p"s + to_string(i), DocumentStatus::ACTUAL, { 1 });
+    }
+    const size_t all_documents = static_cast<size_t>(server.GetDocumentCount());
+
+    const vector<int> ids = GetIds(server.FindTopDocuments("p*"s, SearchAfter{}, all_documents));
+    ASSERT_EQUAL(ids.size(), MAX_PREFIX_EXPANSIONS + 10);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_HINT(count(ids.begin(), ids.end(), word_count + i) == 1, "the frequent words are kept"s);
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("x"s, SearchAfter{}, all_documents).size(), all_documents);
+    ASSERT(server.FindTopDocuments("x -p*"s, SearchAfter{}, all_documents).empty());
+}
+
+void TestFuzzyQueries() {
+    SearchServer server("the"s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cart"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "coast"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "dog she"s, DocumentStatus::ACTUAL, { 4 });
+    server.AddDocument(5, "dog~0 dog~3"s, DocumentStatus::ACTUAL, { 5 });
+
+    auto sorted_ids = [&server](const string& query) {
+        vector<int> ids = GetIds(server.FindTopDocuments(query));
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    ASSERT_EQUAL(sorted_ids("cat~"s), (vector<int>{ 1, 2 }));
+    ASSERT_EQUAL(sorted_ids("cat~1"s), (vector<int>{ 1, 2 }));
+    ASSERT_EQUAL(sorted_ids("cat~2"s), (vector<int>{ 1, 2, 3 }));
+    // The exact word ranks first, every edit weighs less
+    ASSERT_EQUAL(GetIds(server.FindTopDocuments("cat~2"s)), (vector<int>{ 1, 2, 3 }));
+    ASSERT_EQUAL(sorted_ids("dog -cat~"s), (vector<int>{ 4 }));
+    ASSERT_EQUAL(sorted_ids("coast -cat~2"s), vector<int>{});
+    // A stop word stays ignored, "she" is one edit from it
+    ASSERT(server.FindTopDocuments("the~"s).empty());
+
+    // Distances out of range are parts of plain words
+    ASSERT_EQUAL(sorted_ids("dog~0"s), (vector<int>{ 5 }));
+    ASSERT_EQUAL(sorted_ids("dog~3"s), (vector<int>{ 5 }));
+    ASSERT(server.FindTopDocuments("dog~9"s).empty());
+    ASSERT(server.FindTopDocuments("dog~12"s).empty());
+
+    try {
+        server.FindTopDocuments("+cat~"s);
+        ASSERT(false);
+    } catch (const invalid_argument&) {
+    }
+}
+
+namespace {
+
+// The same documents in the same order, relevances equal up to the summation order
+void AssertSameRanking(const vector<Document>& lhs, const vector<Document>& rhs, const string& hint) {
+    ASSERT_EQUAL_HINT(GetIds(lhs), GetIds(rhs), hint);
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        ASSERT_HINT(abs(lhs[i].relevance - rhs[i].relevance) < EPSILON, hint);
+        ASSERT_EQUAL_HINT(lhs[i].rating, rhs[i].rating, hint);
+    }
+}
+
+} // namespace
+
+void TestBatchMatchesSingleQueries() {
+    SearchServer server("and in on"s);
+    const vector<string> texts = {
+        "white cat and yellow hat"s, "curly cat curly tail"s, "nasty dog with big eyes"s,
+        "nasty pigeon john"s, "cat on a mat"s, "dog in the fog"s, "big big cat"s,
+        "yellow dog and white cat"s, "curly pigeon"s, "eyes of a cat"s,
+    };
+    for (size_t i = 0; i < texts.size(); ++i) {
+        server.AddDocument(static_cast<int>(i), texts[i],
+            i % 4 == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { static_cast<int>(i % 3) });
+    }
+
+    // Shared and distinct words, minus, required, prefix and fuzzy words, and misses
+    const vector<string> queries = {
+        "cat"s, "curly cat"s, "nasty dog -eyes"s, "+cat yellow"s, "big cat dog"s,
+        "cu* pigeon"s, "dgo~ fog"s, "and"s, "unknown"s, "cat -cat"s, "white yellow hat cat"s,
+    };
+
+    const auto batch = server.FindTopDocumentsBatch(execution::seq, queries);
+    const auto parallel_batch = server.FindTopDocumentsBatch(execution::par, queries);
+    const auto banned_batch = server.FindTopDocumentsBatch(execution::par, queries, DocumentStatus::BANNED);
+    const auto bm25_batch = server.FindTopDocumentsBatch<Bm25Scorer>(execution::seq, queries);
+    const auto processed = ProcessQueries(server, queries);
+    ASSERT_EQUAL(batch.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const vector<Document> expected = server.FindTopDocuments(queries[i]);
+        AssertSameRanking(batch[i], expected, queries[i]);
+        AssertSameRanking(parallel_batch[i], expected, queries[i]);
+        AssertSameRanking(processed[i], expected, queries[i]);
+        AssertSameRanking(banned_batch[i], server.FindTopDocuments(queries[i], DocumentStatus::BANNED), queries[i]);
+        AssertSameRanking(bm25_batch[i],
+            server.FindTopDocuments<Bm25Scorer>(execution::seq, queries[i], DocumentStatus::ACTUAL), queries[i]);
+    }
+}
+
 // Entry point
- 
\ No newline at end of file
+void TestSearchServer() {
+    RUN_TEST(TestSearchAfterPagesThroughTies);
+    RUN_TEST(TestRequiredWordsFilterDocuments);
+    RUN_TEST(TestPhraseQueries);
+    RUN_TEST(TestPrefixQueries);
+    RUN_TEST(TestFuzzyQueries);
+    RUN_TEST(TestBatchMatchesSingleQueries);
+}
@@ -112,6 +112,28 @@ void RunTestImpl(F foo, const std::string& function_name) {
    
 // sprint 9   
  
+// Paging with a SearchAfter cursor returns every match once, in order, even
+// when many documents share the relevance and the rating
+void TestSearchAfterPagesThroughTies();
+
+// Every "+word" must be in a document, the other words only rank it
+void TestRequiredWordsFilterDocuments();
+
+// The words of a "phrase" must be adjacent once stop words are removed,
+// an empty or unclosed phrase is rejected
+void TestPhraseQueries();
+
+// "prefix*" matches the most frequent MAX_PREFIX_EXPANSIONS words starting
+// with the prefix, "-prefix*" excludes every one of them
+void TestPrefixQueries();
+
+// "word~" and "word~2" match the words within one or two edits, ranked below
+// the exact word; other distances leave a plain word
+void TestFuzzyQueries();
+
+// FindTopDocumentsBatch and ProcessQueries rank every query as FindTopDocuments does
+void TestBatchMatchesSingleQueries();
 
 // Entry point 
- 
\ No newline at end of file
+// Runs every test, aborting on the first failure
+void TestSearchServer();
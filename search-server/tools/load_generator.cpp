@@ -0,0 +1,298 @@
+// Closed-loop load generator for query_server over loopback.
+//
+// Built from the search-server directory with `make tools`.
+//
+//   load_generator [--host 127.0.0.1] [--port N] [--connections N] [--depth N]
+//                  [--seconds N] [--count K] [--queries FILE]
+//
+// Every connection keeps depth requests in flight and sends a new one as soon
+// as a response arrives. Queries come from the file, one per line, or are two
+// random words w0..w9999 as indexed by query_server --synthetic. Latency is
+// measured from sending a request to reading its response.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../histogram.h"
+#include "query_protocol.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct ClientConnection
+	{
+		int fd = -1;
+		std::string input;
+		std::string output;
+		std::unordered_map<uint64_t, Clock::time_point> sent;
+	};
+
+	struct LoadResult
+	{
+		HistogramSnapshot latency_ns;
+		uint64_t errors = 0;
+		Clock::duration elapsed{};
+	};
+
+	int Connect(const std::string& host, uint16_t port)
+	{
+		const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		if (fd < 0 || ::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1
+			|| ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			throw std::runtime_error("Can't connect to "s + host + ":"s + std::to_string(port));
+		}
+		const int no_delay = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+		return fd;
+	}
+
+	class LoadGenerator
+	{
+	public:
+		LoadGenerator(std::vector<std::string> queries, size_t count) :
+			queries_(std::move(queries)), count_(count)
+		{
+		}
+
+		LoadResult Run(const std::string& host, uint16_t port, size_t connection_count, size_t depth,
+			Clock::duration duration)
+		{
+			const int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+			std::vector<ClientConnection> connections(connection_count);
+			for (size_t i = 0; i < connections.size(); ++i)
+			{
+				connections[i].fd = Connect(host, port);
+				epoll_event event{};
+				event.events = EPOLLIN;
+				event.data.u64 = i;
+				::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connections[i].fd, &event);
+			}
+
+			LoadResult result;
+			const Clock::time_point start = Clock::now();
+			const Clock::time_point end = start + duration;
+			for (ClientConnection& connection : connections)
+			{
+				for (size_t i = 0; i < depth; ++i)
+				{
+					Send(connection);
+				}
+				Flush(connection);
+			}
+
+			std::vector<epoll_event> events(connections.size());
+			bool sending = true;
+			size_t in_flight = connections.size() * depth;
+			while (in_flight > 0)
+			{
+				const int count = ::epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 100);
+				if (count < 0 && errno != EINTR)
+				{
+					throw std::runtime_error("epoll_wait failed"s);
+				}
+				const Clock::time_point now = Clock::now();
+				sending = sending && now < end;
+
+				for (int i = 0; i < count; ++i)
+				{
+					ClientConnection& connection = connections[events[i].data.u64];
+					char buffer[1 << 16];
+					const ssize_t size = ::read(connection.fd, buffer, sizeof(buffer));
+					if (size <= 0)
+					{
+						throw std::runtime_error("Server closed the connection"s);
+					}
+					connection.input.append(buffer, static_cast<size_t>(size));
+
+					size_t line_start = 0;
+					for (size_t line_end; (line_end = connection.input.find('\n', line_start)) != std::string::npos; line_start = line_end + 1)
+					{
+						uint64_t request_id = 0;
+						bool is_ok = false;
+						const std::string_view line(connection.input.data() + line_start, line_end - line_start);
+						const auto sent_it = ParseResponseHeader(line, request_id, is_ok)
+							? connection.sent.find(request_id) : connection.sent.end();
+						if (sent_it == connection.sent.end())
+						{
+							throw std::runtime_error("Unexpected response "s + std::string(line));
+						}
+						const uint64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent_it->second).count();
+						result.latency_ns.counts[HistogramSnapshot::BucketIndex(latency_ns)] += 1;
+						result.latency_ns.total += 1;
+						result.latency_ns.sum += latency_ns;
+						result.errors += is_ok ? 0 : 1;
+						connection.sent.erase(sent_it);
+						--in_flight;
+						if (sending)
+						{
+							Send(connection);
+							++in_flight;
+						}
+					}
+					connection.input.erase(0, line_start);
+					Flush(connection);
+				}
+			}
+			result.elapsed = Clock::now() - start;
+
+			for (const ClientConnection& connection : connections)
+			{
+				::close(connection.fd);
+			}
+			::close(epoll_fd);
+			return result;
+		}
+
+	private:
+		const std::vector<std::string> queries_;
+		const size_t count_;
+		std::mt19937 generator_{ 7 };
+		uint64_t next_request_id_ = 1;
+
+		void Send(ClientConnection& connection)
+		{
+			QueryRequest request;
+			request.request_id = next_request_id_++;
+			request.count = count_;
+			if (queries_.empty())
+			{
+				std::uniform_int_distribution<int> word(0, 9999);
+				request.query = "w"s + std::to_string(std::min(word(generator_), word(generator_)))
+					+ " w"s + std::to_string(word(generator_));
+			}
+			else
+			{
+				request.query = queries_[generator_() % queries_.size()];
+			}
+			AppendQueryRequest(connection.output, request);
+			connection.sent.emplace(request.request_id, Clock::now());
+		}
+
+		// The generator blocks on writes: its output is tiny next to the socket buffer
+		static void Flush(ClientConnection& connection)
+		{
+			for (size_t written = 0; written < connection.output.size();)
+			{
+				const ssize_t size = ::send(connection.fd, connection.output.data() + written,
+					connection.output.size() - written, MSG_NOSIGNAL);
+				if (size < 0)
+				{
+					throw std::runtime_error("Can't send a request"s);
+				}
+				written += static_cast<size_t>(size);
+			}
+			connection.output.clear();
+		}
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	std::string host = "127.0.0.1"s;
+	uint16_t port = 7700;
+	size_t connection_count = 4;
+	size_t depth = 8;
+	int seconds = 10;
+	// Documents per response, as FindTopDocuments returns by default
+	size_t count = 5;
+	std::string queries_path;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string option = argv[i];
+		const std::string value = argv[i + 1];
+		if (option == "--host"s)
+		{
+			host = value;
+		}
+		else if (option == "--port"s)
+		{
+			port = static_cast<uint16_t>(std::stoi(value));
+		}
+		else if (option == "--connections"s)
+		{
+			connection_count = std::stoul(value);
+		}
+		else if (option == "--depth"s)
+		{
+			depth = std::stoul(value);
+		}
+		else if (option == "--seconds"s)
+		{
+			seconds = std::stoi(value);
+		}
+		else if (option == "--count"s)
+		{
+			count = std::stoul(value);
+		}
+		else if (option == "--queries"s)
+		{
+			queries_path = value;
+		}
+		else
+		{
+			std::cerr << "Unknown option "s << option << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<std::string> queries;
+	if (!queries_path.empty())
+	{
+		std::ifstream in(queries_path);
+		for (std::string line; std::getline(in, line);)
+		{
+			if (!line.empty())
+			{
+				queries.push_back(line);
+			}
+		}
+	}
+
+	try
+	{
+		LoadGenerator generator(std::move(queries), count);
+		const LoadResult result = generator.Run(host, port, connection_count, depth, std::chrono::seconds(seconds));
+
+		const double elapsed_seconds = std::chrono::duration<double>(result.elapsed).count();
+		const auto microseconds = [&result](double q)
+		{
+			return static_cast<double>(result.latency_ns.Percentile(q)) / 1000.0;
+		};
+		std::cout << std::fixed << std::setprecision(1)
+			<< "requests "s << result.latency_ns.total << ", errors "s << result.errors << '\n'
+			<< "qps "s << static_cast<double>(result.latency_ns.total) / elapsed_seconds << '\n'
+			<< "latency us: mean "s << result.latency_ns.Mean() / 1000.0
+			<< ", p50 "s << microseconds(0.5) << ", p99 "s << microseconds(0.99)
+			<< ", p999 "s << microseconds(0.999) << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+
+#include "query_protocol.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	const std::array<std::string_view, 4> STATUS_NAMES = { "ACTUAL", "IRRELEVANT", "BANNED", "REMOVED" };
+
+	// Cuts the next space-separated token off text
+	std::string_view NextToken(std::string_view& text)
+	{
+		const size_t start = std::min(text.find_first_not_of(' '), text.size());
+		text.remove_prefix(start);
+		const size_t end = std::min(text.find(' '), text.size());
+		const std::string_view token = text.substr(0, end);
+		text.remove_prefix(end);
+		return token;
+	}
+
+	template <typename Number>
+	bool ParseNumber(std::string_view token, Number& value)
+	{
+		const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+		return error == std::errc() && end == token.data() + token.size() && !token.empty();
+	}
+
+	template <typename Number>
+	void AppendNumber(std::string& out, Number value)
+	{
+		std::array<char, 32> buffer;
+		const auto [end, error] = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+		out.append(buffer.data(), end);
+	}
+}
+
+bool ParseQueryRequest(std::string_view line, QueryRequest& request, std::string& error)
+{
+	if (!ParseNumber(NextToken(line), request.request_id))
+	{
+		error = "Bad request id"s;
+		return false;
+	}
+
+	const std::string_view status = NextToken(line);
+	const auto status_it = std::find(STATUS_NAMES.begin(), STATUS_NAMES.end(), status);
+	if (status_it == STATUS_NAMES.end())
+	{
+		error = "Bad status"s;
+		return false;
+	}
+	request.status = static_cast<DocumentStatus>(status_it - STATUS_NAMES.begin());
+
+	if (!ParseNumber(NextToken(line), request.count) || request.count == 0 || request.count > MAX_REQUEST_COUNT)
+	{
+		error = "Bad count"s;
+		return false;
+	}
+
+	const size_t query_start = std::min(line.find_first_not_of(' '), line.size());
+	request.query = std::string(line.substr(query_start));
+	return true;
+}
+
+void AppendQueryRequest(std::string& out, const QueryRequest& request)
+{
+	AppendNumber(out, request.request_id);
+	out += ' ';
+	out += STATUS_NAMES[static_cast<size_t>(request.status)];
+	out += ' ';
+	AppendNumber(out, request.count);
+	out += ' ';
+	out += request.query;
+	out += '\n';
+}
+
+void AppendQueryResponse(std::string& out, uint64_t request_id, const std::vector<Document>& documents)
+{
+	AppendNumber(out, request_id);
+	out += " OK "s;
+	AppendNumber(out, documents.size());
+	for (const Document& document : documents)
+	{
+		out += ' ';
+		AppendNumber(out, document.id);
+		out += ':';
+		AppendNumber(out, document.relevance);
+		out += ':';
+		AppendNumber(out, document.rating);
+	}
+	out += '\n';
+}
+
+void AppendErrorResponse(std::string& out, uint64_t request_id, std::string_view message)
+{
+	AppendNumber(out, request_id);
+	out += " ERR "s;
+	for (const char c : message)
+	{
+		out += c == '\n' ? ' ' : c;
+	}
+	out += '\n';
+}
+
+bool ParseResponseHeader(std::string_view line, uint64_t& request_id, bool& is_ok)
+{
+	if (!ParseNumber(NextToken(line), request_id))
+	{
+		return false;
+	}
+	const std::string_view result = NextToken(line);
+	is_ok = result == "OK";
+	return is_ok || result == "ERR";
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../document.h"
+
+// Line protocol of query_server. Requests and responses are single lines;
+// responses carry the id of their request and may come out of order, so a
+// client can pipeline as many requests as it likes.
+//
+//   request:  <request id> <status> <count> <query>
+//   response: <request id> OK <n> [<id>:<relevance>:<rating>]...
+//             <request id> ERR <message>
+//
+// status is ACTUAL, IRRELEVANT, BANNED or REMOVED, count is the number of
+// documents to return.
+
+const size_t MAX_REQUEST_LINE = 1 << 16;
+const size_t MAX_REQUEST_COUNT = 1000;
+
+struct QueryRequest
+{
+	uint64_t request_id = 0;
+	DocumentStatus status = DocumentStatus::ACTUAL;
+	size_t count = 0;
+	std::string query;
+};
+
+// On failure returns false with an error message; request_id is set if the
+// line has one, so the error can be answered
+bool ParseQueryRequest(std::string_view line, QueryRequest& request, std::string& error);
+
+void AppendQueryRequest(std::string& out, const QueryRequest& request);
+
+void AppendQueryResponse(std::string& out, uint64_t request_id, const std::vector<Document>& documents);
+
+void AppendErrorResponse(std::string& out, uint64_t request_id, std::string_view message);
+
+// Reads the request id of a response line and whether it is OK
+bool ParseResponseHeader(std::string_view line, uint64_t& request_id, bool& is_ok);
@@ -0,0 +1,128 @@
+// Serves a SearchServer over the query_protocol.
+//
+// Built from the search-server directory with `make tools`.
+//
+//   query_server [--port N] [--workers N] [--stop-words "a b"] [--documents FILE | --synthetic N]
+//
+// Every line of the documents file is one document, its id is the line number.
+// --synthetic indexes N random documents over the words w0..w9999, with
+// smaller numbers more frequent; load_generator queries the same words.
+
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../search_server.h"
+#include "query_service.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	QueryService* running_service = nullptr;
+
+	void HandleSignal(int)
+	{
+		if (running_service != nullptr)
+		{
+			running_service->Stop();
+		}
+	}
+
+	const int SYNTHETIC_VOCABULARY = 10000;
+	const int SYNTHETIC_DOCUMENT_WORDS = 20;
+
+	void AddSyntheticDocuments(SearchServer& search_server, int count)
+	{
+		std::mt19937 generator(42);
+		std::uniform_int_distribution<int> word(0, SYNTHETIC_VOCABULARY - 1);
+		std::string text;
+		for (int id = 0; id < count; ++id)
+		{
+			text.clear();
+			for (int i = 0; i < SYNTHETIC_DOCUMENT_WORDS; ++i)
+			{
+				text += 'w';
+				text += std::to_string(std::min(word(generator), word(generator)));
+				text += ' ';
+			}
+			search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 10 });
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	QueryServiceOptions options;
+	std::string stop_words;
+	std::string documents_path;
+	int synthetic_count = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string option = argv[i];
+		const std::string value = argv[i + 1];
+		if (option == "--port"s)
+		{
+			options.port = static_cast<uint16_t>(std::stoi(value));
+		}
+		else if (option == "--workers"s)
+		{
+			options.worker_count = std::stoul(value);
+		}
+		else if (option == "--stop-words"s)
+		{
+			stop_words = value;
+		}
+		else if (option == "--documents"s)
+		{
+			documents_path = value;
+		}
+		else if (option == "--synthetic"s)
+		{
+			synthetic_count = std::stoi(value);
+		}
+		else
+		{
+			std::cerr << "Unknown option "s << option << std::endl;
+			return 1;
+		}
+	}
+
+	try
+	{
+		SearchServer search_server(stop_words);
+		if (!documents_path.empty())
+		{
+			std::ifstream in(documents_path);
+			if (!in)
+			{
+				std::cerr << "Can't open "s << documents_path << std::endl;
+				return 1;
+			}
+			int id = 0;
+			for (std::string line; std::getline(in, line); ++id)
+			{
+				search_server.AddDocument(id, line, DocumentStatus::ACTUAL, {});
+			}
+		}
+		AddSyntheticDocuments(search_server, synthetic_count);
+
+		QueryService service(search_server, options);
+		running_service = &service;
+		std::signal(SIGINT, HandleSignal);
+		std::signal(SIGTERM, HandleSignal);
+		std::cerr << "Serving "s << search_server.GetDocumentCount() << " documents on port "s
+			<< service.GetPort() << std::endl;
+		service.Run();
+		running_service = nullptr;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
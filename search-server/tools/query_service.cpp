@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <execution>
+#include <iterator>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "query_service.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	const uint64_t LISTENER_ID = 0;
+	const uint64_t WAKE_ID = 1;
+	const size_t READ_CHUNK = 1 << 16;
+	// Most tasks a worker takes from the queue at once
+	const size_t WORKER_BATCH = 16;
+	// How long accepting pauses when the process runs out of descriptors,
+	// unless a connection closes sooner
+	const int ACCEPT_RETRY_MS = 100;
+
+	std::system_error LastError(const std::string& what)
+	{
+		return std::system_error(errno, std::generic_category(), what);
+	}
+
+	void AddToEpoll(int epoll_fd, int fd, uint64_t id, uint32_t events)
+	{
+		epoll_event event{};
+		event.events = events;
+		event.data.u64 = id;
+		if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			throw LastError("epoll_ctl"s);
+		}
+	}
+}
+
+QueryService::QueryService(const SearchServer& search_server, QueryServiceOptions options) :
+	search_server_(search_server), options_(std::move(options)), next_connection_id_(WAKE_ID + 1)
+{
+	try
+	{
+		listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listen_fd_ < 0)
+		{
+			throw LastError("socket"s);
+		}
+		const int reuse = 1;
+		::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(options_.port);
+		if (::inet_pton(AF_INET, options_.bind_address.c_str(), &address.sin_addr) != 1)
+		{
+			throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+				"Bad bind address "s + options_.bind_address);
+		}
+		if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+			|| ::listen(listen_fd_, SOMAXCONN) != 0)
+		{
+			throw LastError("Can't listen on "s + options_.bind_address + ":"s + std::to_string(options_.port));
+		}
+		socklen_t address_size = sizeof(address);
+		::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &address_size);
+		port_ = ntohs(address.sin_port);
+
+		epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+		wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (epoll_fd_ < 0 || wake_fd_ < 0)
+		{
+			throw LastError("epoll_create1"s);
+		}
+		AddToEpoll(epoll_fd_, listen_fd_, LISTENER_ID, EPOLLIN);
+		AddToEpoll(epoll_fd_, wake_fd_, WAKE_ID, EPOLLIN);
+	}
+	catch (...)
+	{
+		for (const int fd : { listen_fd_, epoll_fd_, wake_fd_ })
+		{
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+		}
+		throw;
+	}
+
+	const size_t worker_count = options_.worker_count > 0
+		? options_.worker_count : std::max<size_t>(1, std::thread::hardware_concurrency());
+	for (size_t i = 0; i < worker_count; ++i)
+	{
+		workers_.emplace_back(&QueryService::RunWorker, this);
+	}
+}
+
+QueryService::~QueryService()
+{
+	{
+		std::lock_guard g(task_mutex_);
+		workers_stopping_ = true;
+	}
+	task_cv_.notify_all();
+	for (std::thread& worker : workers_)
+	{
+		worker.join();
+	}
+	for (const auto& [id, connection] : connections_)
+	{
+		::close(connection.fd);
+	}
+	::close(wake_fd_);
+	::close(epoll_fd_);
+	::close(listen_fd_);
+}
+
+void QueryService::Run()
+{
+	std::array<epoll_event, 256> events;
+	while (!stopping_.load(std::memory_order_relaxed))
+	{
+		const int count = ::epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()),
+			listener_parked_ ? ACCEPT_RETRY_MS : -1);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw LastError("epoll_wait"s);
+		}
+		if (listener_parked_ && std::chrono::steady_clock::now() >= listener_parked_until_)
+		{
+			ResumeAccepting();
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			const uint64_t id = events[i].data.u64;
+			const uint32_t flags = events[i].events;
+			if (id == LISTENER_ID)
+			{
+				AcceptConnections();
+				continue;
+			}
+			if (id == WAKE_ID)
+			{
+				uint64_t value;
+				while (::read(wake_fd_, &value, sizeof(value)) > 0)
+				{
+				}
+				DeliverCompletions();
+				continue;
+			}
+
+			auto it = connections_.find(id);
+			if (it == connections_.end())
+			{
+				continue;
+			}
+			if (flags & EPOLLERR)
+			{
+				CloseConnection(id);
+				continue;
+			}
+			if (flags & EPOLLHUP)
+			{
+				// Both directions are shut and HUP is reported whatever the event mask,
+				// so the connection goes as soon as what can still be sent is sent
+				if (FlushConnection(id, it->second))
+				{
+					CloseConnection(id);
+				}
+				continue;
+			}
+			if (flags & EPOLLIN)
+			{
+				ReadConnection(id, it->second);
+				it = connections_.find(id);
+			}
+			if (it != connections_.end() && (flags & EPOLLOUT))
+			{
+				FlushConnection(id, it->second);
+			}
+		}
+	}
+}
+
+void QueryService::Stop()
+{
+	stopping_.store(true, std::memory_order_relaxed);
+	const uint64_t one = 1;
+	[[maybe_unused]] const ssize_t result = ::write(wake_fd_, &one, sizeof(one));
+}
+
+void QueryService::AcceptConnections()
+{
+	while (true)
+	{
+		const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			// EAGAIN ends the backlog; other errors concern only that connection
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return;
+			}
+			// The pending connection stays in the backlog and the level-triggered
+			// listener would fire again at once: stop watching it for a while
+			if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+			{
+				::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+				listener_parked_ = true;
+				listener_parked_until_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(ACCEPT_RETRY_MS);
+				return;
+			}
+			continue;
+		}
+		const int no_delay = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+		const uint64_t id = next_connection_id_++;
+		Connection& connection = connections_[id];
+		connection.fd = fd;
+		connection.events = EPOLLIN;
+		AddToEpoll(epoll_fd_, fd, id, connection.events);
+	}
+}
+
+void QueryService::ReadConnection(uint64_t connection_id, Connection& connection)
+{
+	std::vector<Task> tasks;
+	char buffer[READ_CHUNK];
+	while (!connection.read_closed && connection.in_flight < options_.max_in_flight_per_connection)
+	{
+		const ssize_t size = ::read(connection.fd, buffer, sizeof(buffer));
+		if (size > 0)
+		{
+			connection.input.append(buffer, static_cast<size_t>(size));
+			ParseRequests(connection_id, connection, tasks);
+			continue;
+		}
+		if (size == 0)
+		{
+			connection.read_closed = true;
+		}
+		else if (errno == EINTR)
+		{
+			continue;
+		}
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			CloseConnection(connection_id);
+			return;
+		}
+		break;
+	}
+
+	if (!tasks.empty())
+	{
+		{
+			std::lock_guard g(task_mutex_);
+			std::move(tasks.begin(), tasks.end(), std::back_inserter(tasks_));
+		}
+		if (tasks.size() > 1)
+		{
+			task_cv_.notify_all();
+		}
+		else
+		{
+			task_cv_.notify_one();
+		}
+	}
+	FlushConnection(connection_id, connection);
+}
+
+void QueryService::ParseRequests(uint64_t connection_id, Connection& connection, std::vector<Task>& tasks)
+{
+	size_t line_start = 0;
+	std::string error;
+	for (size_t line_end; (line_end = connection.input.find('\n', line_start)) != std::string::npos; line_start = line_end + 1)
+	{
+		std::string_view line(connection.input.data() + line_start, line_end - line_start);
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.remove_suffix(1);
+		}
+		if (line.empty())
+		{
+			continue;
+		}
+
+		Task task{ connection_id, {} };
+		if (ParseQueryRequest(line, task.request, error))
+		{
+			tasks.push_back(std::move(task));
+			++connection.in_flight;
+		}
+		else
+		{
+			AppendErrorResponse(connection.output, task.request.request_id, error);
+		}
+	}
+	connection.input.erase(0, line_start);
+
+	if (connection.input.size() > MAX_REQUEST_LINE)
+	{
+		AppendErrorResponse(connection.output, 0, "Request line is too long"s);
+		connection.input.clear();
+		connection.read_closed = true;
+	}
+}
+
+void QueryService::DeliverCompletions()
+{
+	std::vector<Completion> completions;
+	{
+		std::lock_guard g(completion_mutex_);
+		completions.swap(completions_);
+	}
+
+	std::vector<uint64_t> touched;
+	for (Completion& completion : completions)
+	{
+		const auto it = connections_.find(completion.connection_id);
+		if (it == connections_.end())
+		{
+			continue;
+		}
+		it->second.output += completion.response;
+		--it->second.in_flight;
+		touched.push_back(completion.connection_id);
+	}
+
+	std::sort(touched.begin(), touched.end());
+	touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+	for (const uint64_t id : touched)
+	{
+		FlushConnection(id, connections_.at(id));
+	}
+}
+
+bool QueryService::FlushConnection(uint64_t connection_id, Connection& connection)
+{
+	size_t written = 0;
+	while (written < connection.output.size())
+	{
+		const ssize_t size = ::send(connection.fd, connection.output.data() + written,
+			connection.output.size() - written, MSG_NOSIGNAL);
+		if (size >= 0)
+		{
+			written += static_cast<size_t>(size);
+			continue;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			break;
+		}
+		CloseConnection(connection_id);
+		return false;
+	}
+	connection.output.erase(0, written);
+
+	if (connection.read_closed && connection.in_flight == 0 && connection.output.empty())
+	{
+		CloseConnection(connection_id);
+		return false;
+	}
+	UpdateEvents(connection_id, connection);
+	return true;
+}
+
+void QueryService::UpdateEvents(uint64_t connection_id, Connection& connection)
+{
+	uint32_t events = 0;
+	if (!connection.read_closed && connection.in_flight < options_.max_in_flight_per_connection)
+	{
+		events |= EPOLLIN;
+	}
+	if (!connection.output.empty())
+	{
+		events |= EPOLLOUT;
+	}
+	if (events == connection.events)
+	{
+		return;
+	}
+
+	epoll_event event{};
+	event.events = events;
+	event.data.u64 = connection_id;
+	::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+	connection.events = events;
+}
+
+void QueryService::ResumeAccepting()
+{
+	if (listener_parked_)
+	{
+		listener_parked_ = false;
+		AddToEpoll(epoll_fd_, listen_fd_, LISTENER_ID, EPOLLIN);
+	}
+}
+
+void QueryService::CloseConnection(uint64_t connection_id)
+{
+	const auto it = connections_.find(connection_id);
+	::close(it->second.fd);
+	connections_.erase(it);
+	// A descriptor is free again
+	ResumeAccepting();
+}
+
+void QueryService::RunWorker()
+{
+	std::vector<Task> batch;
+	std::vector<Completion> completions;
+	while (true)
+	{
+		{
+			std::unique_lock lock(task_mutex_);
+			task_cv_.wait(lock, [this] { return workers_stopping_ || !tasks_.empty(); });
+			if (workers_stopping_)
+			{
+				return;
+			}
+			// Share a burst between the workers instead of letting one take it all
+			const size_t take = std::clamp<size_t>(tasks_.size() / workers_.size(), 1, WORKER_BATCH);
+			std::move(tasks_.begin(), tasks_.begin() + take, std::back_inserter(batch));
+			tasks_.erase(tasks_.begin(), tasks_.begin() + take);
+		}
+
+		for (Task& task : batch)
+		{
+			Completion completion{ task.connection_id, {} };
+			try
+			{
+				const std::vector<Document> documents = search_server_.FindTopDocuments(std::execution::seq,
+					task.request.query, task.request.status, SearchAfter{}, task.request.count);
+				AppendQueryResponse(completion.response, task.request.request_id, documents);
+			}
+			catch (const std::exception& e)
+			{
+				AppendErrorResponse(completion.response, task.request.request_id, e.what());
+			}
+			completions.push_back(std::move(completion));
+		}
+		batch.clear();
+
+		bool was_empty;
+		{
+			std::lock_guard g(completion_mutex_);
+			was_empty = completions_.empty();
+			std::move(completions.begin(), completions.end(), std::back_inserter(completions_));
+		}
+		completions.clear();
+		// The reactor takes every queued completion per wake-up, one signal is enough
+		if (was_empty)
+		{
+			const uint64_t one = 1;
+			[[maybe_unused]] const ssize_t result = ::write(wake_fd_, &one, sizeof(one));
+		}
+	}
+}
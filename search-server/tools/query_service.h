@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../search_server.h"
+#include "query_protocol.h"
+
+struct QueryServiceOptions
+{
+	std::string bind_address = "127.0.0.1";
+	// 0 picks a free port, see GetPort
+	uint16_t port = 7700;
+	// 0 means one worker per hardware thread
+	size_t worker_count = 0;
+	// A connection is not read while this many of its requests are unanswered
+	size_t max_in_flight_per_connection = 1024;
+};
+
+// Serves the query_protocol over TCP. One reactor thread owns every socket:
+// it accepts, reads and parses requests with non-blocking I/O driven by
+// epoll, and hands them to the workers in batches. Workers run the queries
+// and queue the responses, waking the reactor through an eventfd once per
+// batch; the reactor then writes all responses of a connection at once.
+class QueryService
+{
+public:
+	// Binds and listens; throws std::system_error on failure
+	QueryService(const SearchServer& search_server, QueryServiceOptions options = {});
+
+	QueryService(const QueryService&) = delete;
+	QueryService& operator=(const QueryService&) = delete;
+
+	~QueryService();
+
+	uint16_t GetPort() const { return port_; }
+
+	// Runs the reactor on the calling thread until Stop
+	void Run();
+
+	// May be called from any thread, also from a signal handler
+	void Stop();
+
+private:
+	struct Connection
+	{
+		int fd = -1;
+		std::string input;
+		std::string output;
+		size_t in_flight = 0;
+		bool read_closed = false;
+		uint32_t events = 0;
+	};
+
+	struct Task
+	{
+		uint64_t connection_id;
+		QueryRequest request;
+	};
+
+	struct Completion
+	{
+		uint64_t connection_id;
+		std::string response;
+	};
+
+	const SearchServer& search_server_;
+	const QueryServiceOptions options_;
+	int listen_fd_ = -1;
+	int epoll_fd_ = -1;
+	int wake_fd_ = -1;
+	uint16_t port_ = 0;
+	std::atomic<bool> stopping_{ false };
+
+	// Owned by the reactor thread
+	std::unordered_map<uint64_t, Connection> connections_;
+	uint64_t next_connection_id_;
+	// The listener is out of epoll after accept ran out of descriptors,
+	// until a connection closes or the retry time comes
+	bool listener_parked_ = false;
+	std::chrono::steady_clock::time_point listener_parked_until_;
+
+	std::mutex task_mutex_;
+	std::condition_variable task_cv_;
+	std::deque<Task> tasks_;
+	bool workers_stopping_ = false;
+	std::vector<std::thread> workers_;
+
+	std::mutex completion_mutex_;
+	std::vector<Completion> completions_;
+
+	void AcceptConnections();
+	void ResumeAccepting();
+	void ReadConnection(uint64_t connection_id, Connection& connection);
+	void ParseRequests(uint64_t connection_id, Connection& connection, std::vector<Task>& tasks);
+	void DeliverCompletions();
+	// Returns false if the connection was closed
+	bool FlushConnection(uint64_t connection_id, Connection& connection);
+	void UpdateEvents(uint64_t connection_id, Connection& connection);
+	void CloseConnection(uint64_t connection_id);
+
+	void RunWorker();
+};
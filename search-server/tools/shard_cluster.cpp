@@ -0,0 +1,300 @@
+// Serves a collection from several processes: one worker per shard, each
+// with its own SearchServer, and a coordinator merging their answers.
+//
+// Built from the search-server directory with `make tools`.
+//
+//   shard_cluster --documents FILE [--shards N] [--stop-words "a b"] [--socket-dir DIR] [--scorer tf-idf|bm25]
+//   shard_cluster --worker --documents FILE --shard I --shards N --socket PATH [--stop-words "a b"]
+//   shard_cluster --connect PATH,PATH,... [--scorer tf-idf|bm25]
+//
+// Line i of the documents file is document i and lives on shard i % N. The
+// first form starts a worker process per shard and coordinates them, the
+// other two run the parts on their own. The coordinator reads query_protocol
+// requests from stdin and writes the responses to stdout; answers missing
+// dead shards are reported on stderr.
+
+#include <algorithm>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../search_server.h"
+#include "query_protocol.h"
+#include "shard_coordinator.h"
+#include "shard_worker.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	ShardWorker* running_worker = nullptr;
+
+	void HandleSignal(int)
+	{
+		if (running_worker != nullptr)
+		{
+			running_worker->Stop();
+		}
+	}
+
+	struct ClusterOptions
+	{
+		std::string documents_path;
+		std::string stop_words;
+		size_t shard_count = 4;
+		size_t shard = 0;
+		std::string socket_path;
+		std::string socket_dir = "/tmp"s;
+		std::vector<std::string> connect_paths;
+		ShardScorer scorer = ShardScorer::TF_IDF;
+		bool is_worker = false;
+	};
+
+	std::unique_ptr<SearchServer> LoadShard(const ClusterOptions& options, size_t shard)
+	{
+		std::ifstream in(options.documents_path);
+		if (!in)
+		{
+			throw std::runtime_error("Can't open "s + options.documents_path);
+		}
+		IndexOptions index_options;
+		index_options.store_content = false;
+		auto search_server = std::make_unique<SearchServer>(options.stop_words, index_options);
+		int id = 0;
+		for (std::string line; std::getline(in, line); ++id)
+		{
+			if (static_cast<size_t>(id) % options.shard_count == shard)
+			{
+				search_server->AddDocument(id, line, DocumentStatus::ACTUAL, {});
+			}
+		}
+		return search_server;
+	}
+
+	// ready_fd, if any, gets a byte once the shard is listening
+	void RunWorker(const ClusterOptions& options, size_t shard, const std::string& socket_path, int ready_fd)
+	{
+		const std::unique_ptr<SearchServer> search_server = LoadShard(options, shard);
+		ShardWorker worker(*search_server, socket_path);
+		running_worker = &worker;
+		std::signal(SIGINT, HandleSignal);
+		std::signal(SIGTERM, HandleSignal);
+		std::cerr << "Shard "s << shard << " serves "s << search_server->GetDocumentCount()
+			<< " documents on "s << socket_path << std::endl;
+		if (ready_fd >= 0)
+		{
+			const char ready = 1;
+			::write(ready_fd, &ready, 1);
+			::close(ready_fd);
+		}
+		worker.Run();
+		running_worker = nullptr;
+	}
+
+	// Forks a worker per shard and waits until all of them listen
+	std::vector<pid_t> StartWorkers(const ClusterOptions& options, std::vector<std::string>& socket_paths)
+	{
+		std::vector<pid_t> pids;
+		std::vector<int> ready_fds;
+		for (size_t shard = 0; shard < options.shard_count; ++shard)
+		{
+			socket_paths.push_back(options.socket_dir + "/search-shard-"s + std::to_string(::getpid())
+				+ "-"s + std::to_string(shard) + ".sock"s);
+			int pipe_fds[2];
+			if (::pipe(pipe_fds) != 0)
+			{
+				throw std::runtime_error("Can't create a pipe"s);
+			}
+			const pid_t pid = ::fork();
+			if (pid < 0)
+			{
+				throw std::runtime_error("Can't start a worker"s);
+			}
+			if (pid == 0)
+			{
+				// The worker goes down with the coordinator
+				::prctl(PR_SET_PDEATHSIG, SIGTERM);
+				::close(pipe_fds[0]);
+				int status = 0;
+				try
+				{
+					RunWorker(options, shard, socket_paths.back(), pipe_fds[1]);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "Shard "s << shard << ": "s << e.what() << std::endl;
+					status = 1;
+				}
+				std::_Exit(status);
+			}
+			::close(pipe_fds[1]);
+			pids.push_back(pid);
+			ready_fds.push_back(pipe_fds[0]);
+		}
+
+		for (const int fd : ready_fds)
+		{
+			// A worker that fails to start closes the pipe without a byte; the
+			// coordinator then serves without it
+			char ready = 0;
+			::read(fd, &ready, 1);
+			::close(fd);
+		}
+		return pids;
+	}
+
+	void StopWorkers(const std::vector<pid_t>& pids)
+	{
+		for (const pid_t pid : pids)
+		{
+			::kill(pid, SIGTERM);
+		}
+		for (const pid_t pid : pids)
+		{
+			::waitpid(pid, nullptr, 0);
+		}
+	}
+
+	void Coordinate(const std::vector<std::string>& socket_paths, ShardScorer scorer)
+	{
+		ShardCoordinator coordinator(socket_paths);
+		std::cerr << "Coordinating "s << coordinator.GetLiveShardCount() << " of "s
+			<< coordinator.GetShardCount() << " shards"s << std::endl;
+
+		std::string output;
+		QueryRequest request;
+		std::string error;
+		for (std::string line; std::getline(std::cin, line);)
+		{
+			output.clear();
+			if (!ParseQueryRequest(line, request, error))
+			{
+				AppendErrorResponse(output, request.request_id, error);
+			}
+			else
+			{
+				try
+				{
+					const SearchResult result = coordinator.FindTopDocuments(request.query, request.status, request.count, scorer);
+					AppendQueryResponse(output, request.request_id, result.documents);
+					if (result.is_partial)
+					{
+						std::cerr << "Request "s << request.request_id << ": "s << coordinator.GetLiveShardCount()
+							<< " of "s << coordinator.GetShardCount() << " shards answered"s << std::endl;
+					}
+				}
+				catch (const std::exception& e)
+				{
+					AppendErrorResponse(output, request.request_id, e.what());
+				}
+			}
+			std::cout << output << std::flush;
+		}
+	}
+
+	std::vector<std::string> SplitPaths(const std::string& text)
+	{
+		std::vector<std::string> paths;
+		std::istringstream in(text);
+		for (std::string path; std::getline(in, path, ',');)
+		{
+			paths.push_back(path);
+		}
+		return paths;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	ClusterOptions options;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string option = argv[i];
+		if (option == "--worker"s)
+		{
+			options.is_worker = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			std::cerr << "Missing value of "s << option << std::endl;
+			return 1;
+		}
+		const std::string value = argv[++i];
+		if (option == "--documents"s)
+		{
+			options.documents_path = value;
+		}
+		else if (option == "--stop-words"s)
+		{
+			options.stop_words = value;
+		}
+		else if (option == "--shards"s)
+		{
+			options.shard_count = std::max<size_t>(1, std::stoul(value));
+		}
+		else if (option == "--shard"s)
+		{
+			options.shard = std::stoul(value);
+		}
+		else if (option == "--socket"s)
+		{
+			options.socket_path = value;
+		}
+		else if (option == "--socket-dir"s)
+		{
+			options.socket_dir = value;
+		}
+		else if (option == "--connect"s)
+		{
+			options.connect_paths = SplitPaths(value);
+		}
+		else if (option == "--scorer"s)
+		{
+			if (value != "tf-idf"s && value != "bm25"s)
+			{
+				std::cerr << "Unknown scorer "s << value << std::endl;
+				return 1;
+			}
+			options.scorer = value == "bm25"s ? ShardScorer::BM25 : ShardScorer::TF_IDF;
+		}
+		else
+		{
+			std::cerr << "Unknown option "s << option << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<pid_t> pids;
+	try
+	{
+		if (options.is_worker)
+		{
+			RunWorker(options, options.shard, options.socket_path, -1);
+			return 0;
+		}
+		std::vector<std::string> socket_paths = options.connect_paths;
+		if (socket_paths.empty())
+		{
+			pids = StartWorkers(options, socket_paths);
+		}
+		Coordinate(socket_paths, options.scorer);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		StopWorkers(pids);
+		return 1;
+	}
+	StopWorkers(pids);
+	return 0;
+}
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "shard_coordinator.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	int Connect(const std::string& socket_path, std::chrono::milliseconds timeout)
+	{
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (socket_path.size() >= sizeof(address.sun_path))
+		{
+			return -1;
+		}
+		std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+		const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+		{
+			return -1;
+		}
+		// Blocking I/O bounded by the timeout, a hung worker can't stall the coordinator
+		timeval tv{};
+		tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+		tv.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000);
+		if (::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0
+			|| ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0
+			|| ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			::close(fd);
+			return -1;
+		}
+		return fd;
+	}
+}
+
+ShardCoordinator::ShardCoordinator(std::vector<std::string> socket_paths, ShardCoordinatorOptions options)
+	: options_(options)
+{
+	if (socket_paths.empty())
+	{
+		throw std::invalid_argument("No shards"s);
+	}
+	for (std::string& socket_path : socket_paths)
+	{
+		shards_.push_back({ std::move(socket_path) });
+	}
+	std::lock_guard lock(mutex_);
+	ConnectDueShards();
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+	for (Shard& shard : shards_)
+	{
+		Disconnect(shard);
+	}
+}
+
+SearchResult ShardCoordinator::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t count,
+	ShardScorer scorer)
+{
+	std::lock_guard lock(mutex_);
+	ConnectDueShards();
+
+	// Phase one: the statistics of every partition
+	std::vector<std::optional<ShardMessage>> requests(shards_.size());
+	for (size_t i = 0; i < shards_.size(); ++i)
+	{
+		if (shards_[i].fd >= 0)
+		{
+			ShardMessage& request = requests[i].emplace();
+			request.type = ShardMessageType::STATS_REQUEST;
+			request.request_id = next_request_id_++;
+			request.text = std::string(raw_query);
+		}
+	}
+	const std::vector<std::optional<ShardMessage>> stats_responses = FanOut(requests);
+
+	CollectionStats stats;
+	for (size_t i = 0; i < shards_.size(); ++i)
+	{
+		if (CheckResponse(shards_[i], stats_responses[i], ShardMessageType::STATS_RESPONSE))
+		{
+			stats += stats_responses[i]->stats;
+		}
+	}
+
+	// Phase two: every partition ranks with the sums, only those that gave their statistics
+	for (size_t i = 0; i < shards_.size(); ++i)
+	{
+		requests[i].reset();
+		if (stats_responses[i] && shards_[i].fd >= 0)
+		{
+			ShardMessage& request = requests[i].emplace();
+			request.type = ShardMessageType::SEARCH_REQUEST;
+			request.request_id = next_request_id_++;
+			request.status = status;
+			request.count = count;
+			request.scorer = scorer;
+			request.stats = stats;
+			request.text = std::string(raw_query);
+		}
+	}
+	const std::vector<std::optional<ShardMessage>> search_responses = FanOut(requests);
+
+	SearchResult result;
+	for (size_t i = 0; i < shards_.size(); ++i)
+	{
+		const auto& response = search_responses[i];
+		if (!CheckResponse(shards_[i], response, ShardMessageType::SEARCH_RESPONSE))
+		{
+			result.is_partial = true;
+			continue;
+		}
+		result.documents.insert(result.documents.end(), response->documents.begin(), response->documents.end());
+	}
+
+	const size_t kept = std::min(count, result.documents.size());
+	std::partial_sort(result.documents.begin(), result.documents.begin() + kept, result.documents.end(), IsRankedHigher);
+	result.documents.resize(kept);
+	return result;
+}
+
+size_t ShardCoordinator::GetLiveShardCount() const
+{
+	std::lock_guard lock(mutex_);
+	return std::count_if(shards_.begin(), shards_.end(), [](const Shard& shard) { return shard.fd >= 0; });
+}
+
+void ShardCoordinator::ConnectDueShards()
+{
+	const Clock::time_point now = Clock::now();
+	for (Shard& shard : shards_)
+	{
+		if (shard.fd < 0 && now >= shard.next_connect)
+		{
+			shard.fd = Connect(shard.socket_path, options_.timeout);
+			shard.next_connect = now + options_.reconnect_interval;
+		}
+	}
+}
+
+void ShardCoordinator::Disconnect(Shard& shard)
+{
+	if (shard.fd >= 0)
+	{
+		::close(shard.fd);
+		shard.fd = -1;
+		shard.next_connect = Clock::now() + options_.reconnect_interval;
+	}
+}
+
+bool ShardCoordinator::CheckResponse(Shard& shard, const std::optional<ShardMessage>& response, ShardMessageType type)
+{
+	if (!response)
+	{
+		return false;
+	}
+	if (response->type == ShardMessageType::ERROR_RESPONSE)
+	{
+		throw std::invalid_argument(response->text);
+	}
+	if (response->type != type)
+	{
+		// Out of protocol, its stream can't be trusted any more
+		Disconnect(shard);
+		return false;
+	}
+	return true;
+}
+
+std::vector<std::optional<ShardMessage>> ShardCoordinator::FanOut(const std::vector<std::optional<ShardMessage>>& requests)
+{
+	// All the requests go out before the first answer is awaited, so the workers run in parallel
+	std::string frame;
+	for (size_t i = 0; i < shards_.size(); ++i)
+	{
+		if (requests[i] && shards_[i].fd >= 0)
+		{
+			frame.clear();
+			AppendShardMessage(frame, *requests[i]);
+			if (!WriteShardFrames(shards_[i].fd, frame))
+			{
+				Disconnect(shards_[i]);
+			}
+		}
+	}
+
+	std::vector<std::optional<ShardMessage>> responses(shards_.size());
+	for (size_t i = 0; i < shards_.size(); ++i)
+	{
+		if (!requests[i] || shards_[i].fd < 0)
+		{
+			continue;
+		}
+		ShardMessage response;
+		if (!ReadShardFrame(shards_[i].fd, frame) || !ParseShardMessage(frame, response)
+			|| response.request_id != requests[i]->request_id)
+		{
+			Disconnect(shards_[i]);
+			continue;
+		}
+		responses[i] = std::move(response);
+	}
+	return responses;
+}
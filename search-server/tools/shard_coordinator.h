@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../search_server.h"
+#include "shard_protocol.h"
+
+struct ShardCoordinatorOptions
+{
+	// A worker that does not answer in time is taken for dead
+	std::chrono::milliseconds timeout{ 2000 };
+	// How often a dead worker is tried again
+	std::chrono::milliseconds reconnect_interval{ 1000 };
+};
+
+// Fans queries out to the ShardWorkers of a collection and merges their
+// results. Every search first sums the query statistics of the workers and
+// sends them back with the query, so rankings are those of one index over
+// the whole collection. The exception is prefix* and word~ queries: every
+// worker expands them within its own partition and caps, so the plus-words
+// and their document frequencies can differ from those of a single index.
+//
+// A worker that fails, closes its socket, times out or breaks the protocol
+// is dropped until a reconnect succeeds. Searches go on over the other workers and return
+// is_partial: the documents of the dead partitions are missing and the
+// document frequencies cover the live ones only.
+//
+// Searches are serialized: each worker has one connection and answers in order.
+class ShardCoordinator
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit ShardCoordinator(std::vector<std::string> socket_paths, ShardCoordinatorOptions options = {});
+	~ShardCoordinator();
+
+	ShardCoordinator(const ShardCoordinator&) = delete;
+	ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+	// Throws std::invalid_argument for a query a worker rejects, in either phase
+	SearchResult FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+		size_t count = MAX_RESULT_DOCUMENT_COUNT, ShardScorer scorer = ShardScorer::TF_IDF);
+
+	size_t GetShardCount() const { return shards_.size(); }
+	size_t GetLiveShardCount() const;
+
+private:
+	struct Shard
+	{
+		std::string socket_path;
+		int fd = -1;
+		Clock::time_point next_connect{};
+	};
+
+	const ShardCoordinatorOptions options_;
+	mutable std::mutex mutex_;
+	std::vector<Shard> shards_;
+	uint64_t next_request_id_ = 1;
+
+	void ConnectDueShards();
+	void Disconnect(Shard& shard);
+
+	// True for an answer of the expected type. Throws the error a worker
+	// answered with; drops a worker that answered out of protocol
+	bool CheckResponse(Shard& shard, const std::optional<ShardMessage>& response, ShardMessageType type);
+
+	// Sends the request to every connected worker, then reads their answers.
+	// A worker failing either is disconnected and has no answer
+	std::vector<std::optional<ShardMessage>> FanOut(const std::vector<std::optional<ShardMessage>>& requests);
+};
@@ -0,0 +1,249 @@
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../varint.h"
+#include "shard_protocol.h"
+
+namespace
+{
+	const size_t FRAME_HEADER_SIZE = 4;
+
+	uint64_t ZigZag(int64_t value)
+	{
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	int64_t UnZigZag(uint64_t value)
+	{
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	void AppendString(std::string& out, std::string_view text)
+	{
+		AppendVarint(out, text.size());
+		out += text;
+	}
+
+	bool ReadString(std::string_view& in, std::string& text)
+	{
+		uint64_t size = 0;
+		if (!ReadVarint(in, size) || size > in.size())
+		{
+			return false;
+		}
+		text.assign(in.substr(0, size));
+		in.remove_prefix(size);
+		return true;
+	}
+
+	void AppendDouble(std::string& out, double value)
+	{
+		char bytes[sizeof(double)];
+		std::memcpy(bytes, &value, sizeof(double));
+		out.append(bytes, sizeof(double));
+	}
+
+	bool ReadDouble(std::string_view& in, double& value)
+	{
+		if (in.size() < sizeof(double))
+		{
+			return false;
+		}
+		std::memcpy(&value, in.data(), sizeof(double));
+		in.remove_prefix(sizeof(double));
+		return true;
+	}
+
+	void AppendStats(std::string& out, const CollectionStats& stats)
+	{
+		AppendVarint(out, stats.document_count);
+		AppendVarint(out, stats.word_count);
+		AppendVarint(out, stats.document_freqs.size());
+		for (const auto& [word, document_freq] : stats.document_freqs)
+		{
+			AppendString(out, word);
+			AppendVarint(out, document_freq);
+		}
+	}
+
+	bool ReadStats(std::string_view& in, CollectionStats& stats)
+	{
+		uint64_t word_count = 0;
+		if (!ReadVarint(in, stats.document_count) || !ReadVarint(in, stats.word_count) || !ReadVarint(in, word_count))
+		{
+			return false;
+		}
+		std::string word;
+		for (uint64_t i = 0; i < word_count; ++i)
+		{
+			uint64_t document_freq = 0;
+			if (!ReadString(in, word) || !ReadVarint(in, document_freq))
+			{
+				return false;
+			}
+			stats.document_freqs[word] = document_freq;
+		}
+		return true;
+	}
+}
+
+void AppendShardMessage(std::string& out, const ShardMessage& message)
+{
+	const size_t header = out.size();
+	out.append(FRAME_HEADER_SIZE, '\0');
+
+	out.push_back(static_cast<char>(message.type));
+	AppendVarint(out, message.request_id);
+	switch (message.type)
+	{
+	case ShardMessageType::STATS_REQUEST:
+		AppendString(out, message.text);
+		break;
+	case ShardMessageType::STATS_RESPONSE:
+		AppendStats(out, message.stats);
+		break;
+	case ShardMessageType::SEARCH_REQUEST:
+		AppendVarint(out, static_cast<uint64_t>(message.status));
+		AppendVarint(out, message.count);
+		AppendVarint(out, static_cast<uint64_t>(message.scorer));
+		AppendStats(out, message.stats);
+		AppendString(out, message.text);
+		break;
+	case ShardMessageType::SEARCH_RESPONSE:
+		AppendVarint(out, message.documents.size());
+		for (const Document& document : message.documents)
+		{
+			AppendVarint(out, ZigZag(document.id));
+			AppendDouble(out, document.relevance);
+			AppendVarint(out, ZigZag(document.rating));
+		}
+		break;
+	case ShardMessageType::ERROR_RESPONSE:
+		AppendString(out, message.text);
+		break;
+	}
+
+	const uint32_t size = static_cast<uint32_t>(out.size() - header - FRAME_HEADER_SIZE);
+	for (size_t i = 0; i < FRAME_HEADER_SIZE; ++i)
+	{
+		out[header + i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+	}
+}
+
+bool ParseShardMessage(std::string_view frame, ShardMessage& message)
+{
+	message = {};
+	if (frame.empty())
+	{
+		return false;
+	}
+	message.type = static_cast<ShardMessageType>(frame.front());
+	frame.remove_prefix(1);
+	if (!ReadVarint(frame, message.request_id))
+	{
+		return false;
+	}
+
+	bool is_valid = false;
+	switch (message.type)
+	{
+	case ShardMessageType::STATS_REQUEST:
+	case ShardMessageType::ERROR_RESPONSE:
+		is_valid = ReadString(frame, message.text);
+		break;
+	case ShardMessageType::STATS_RESPONSE:
+		is_valid = ReadStats(frame, message.stats);
+		break;
+	case ShardMessageType::SEARCH_REQUEST:
+	{
+		uint64_t status = 0;
+		uint64_t count = 0;
+		uint64_t scorer = 0;
+		is_valid = ReadVarint(frame, status) && status <= static_cast<uint64_t>(DocumentStatus::REMOVED)
+			&& ReadVarint(frame, count)
+			&& ReadVarint(frame, scorer) && scorer <= static_cast<uint64_t>(ShardScorer::BM25)
+			&& ReadStats(frame, message.stats) && ReadString(frame, message.text);
+		message.status = static_cast<DocumentStatus>(status);
+		message.count = count;
+		message.scorer = static_cast<ShardScorer>(scorer);
+		break;
+	}
+	case ShardMessageType::SEARCH_RESPONSE:
+	{
+		uint64_t document_count = 0;
+		is_valid = ReadVarint(frame, document_count);
+		for (uint64_t i = 0; is_valid && i < document_count; ++i)
+		{
+			uint64_t id = 0;
+			uint64_t rating = 0;
+			Document document;
+			is_valid = ReadVarint(frame, id) && ReadDouble(frame, document.relevance) && ReadVarint(frame, rating);
+			document.id = static_cast<int>(UnZigZag(id));
+			document.rating = static_cast<int>(UnZigZag(rating));
+			message.documents.push_back(document);
+		}
+		break;
+	}
+	}
+	return is_valid && frame.empty();
+}
+
+bool WriteShardFrames(int fd, std::string_view frames)
+{
+	while (!frames.empty())
+	{
+		const ssize_t size = ::send(fd, frames.data(), frames.size(), MSG_NOSIGNAL);
+		if (size < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (size <= 0)
+		{
+			return false;
+		}
+		frames.remove_prefix(static_cast<size_t>(size));
+	}
+	return true;
+}
+
+bool ReadShardFrame(int fd, std::string& frame)
+{
+	auto read_exactly = [fd](char* data, size_t size)
+	{
+		while (size > 0)
+		{
+			const ssize_t result = ::read(fd, data, size);
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (result <= 0)
+			{
+				return false;
+			}
+			data += result;
+			size -= static_cast<size_t>(result);
+		}
+		return true;
+	};
+
+	unsigned char header[FRAME_HEADER_SIZE];
+	if (!read_exactly(reinterpret_cast<char*>(header), FRAME_HEADER_SIZE))
+	{
+		return false;
+	}
+	uint32_t size = 0;
+	for (size_t i = 0; i < FRAME_HEADER_SIZE; ++i)
+	{
+		size |= static_cast<uint32_t>(header[i]) << (8 * i);
+	}
+	if (size > MAX_SHARD_FRAME)
+	{
+		return false;
+	}
+	frame.resize(size);
+	return read_exactly(frame.data(), size);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../document.h"
+#include "../search_server.h"
+
+// Binary protocol between shard_coordinator and the shard workers over Unix
+// domain sockets. A frame is a 4-byte little-endian length, then the message
+// type and its fields. Integers are LEB128 varints, signed ones zigzag coded,
+// strings a varint length and the bytes, relevances the 8 bytes of a double.
+//
+// A search takes two round trips:
+//   STATS_REQUEST  id query                            -> STATS_RESPONSE id stats
+//   SEARCH_REQUEST id status count scorer stats query  -> SEARCH_RESPONSE id documents
+// where the coordinator sums the stats of all the workers between the two,
+// so that every worker ranks with the document frequencies of the whole
+// collection. scorer is a ShardScorer. Any request may be answered with
+// ERROR_RESPONSE id message.
+//
+// stats: document_count word_count n (word document_freq)...
+// documents: n (id relevance rating)...
+
+const size_t MAX_SHARD_FRAME = 64 << 20;
+
+enum class ShardMessageType : uint8_t
+{
+	STATS_REQUEST = 1,
+	STATS_RESPONSE,
+	SEARCH_REQUEST,
+	SEARCH_RESPONSE,
+	ERROR_RESPONSE,
+};
+
+// The scoring model a worker ranks with, TfIdfScorer or Bm25Scorer
+enum class ShardScorer : uint8_t
+{
+	TF_IDF,
+	BM25,
+};
+
+// The fields a type does not carry are left empty
+struct ShardMessage
+{
+	ShardMessageType type = ShardMessageType::ERROR_RESPONSE;
+	uint64_t request_id = 0;
+	DocumentStatus status = DocumentStatus::ACTUAL;
+	size_t count = 0;
+	ShardScorer scorer = ShardScorer::TF_IDF;
+	// The query, or the message of an error
+	std::string text;
+	CollectionStats stats;
+	std::vector<Document> documents;
+};
+
+// Appends the whole frame, length included
+void AppendShardMessage(std::string& out, const ShardMessage& message);
+
+// Parses a frame without its length, false if it is malformed
+bool ParseShardMessage(std::string_view frame, ShardMessage& message);
+
+// Blocking I/O of whole frames on a socket. Both return false on an error,
+// a timeout of the socket or a closed connection; ReadShardFrame also on a
+// frame over MAX_SHARD_FRAME. The frame read has no length
+bool WriteShardFrames(int fd, std::string_view frames);
+bool ReadShardFrame(int fd, std::string& frame);
@@ -0,0 +1,144 @@
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "shard_protocol.h"
+#include "shard_worker.h"
+
+using namespace std::string_literals;
+
+namespace
+{
+	std::system_error LastError(const std::string& what)
+	{
+		return std::system_error(errno, std::generic_category(), what);
+	}
+}
+
+ShardWorker::ShardWorker(const SearchServer& search_server, const std::string& socket_path)
+	: search_server_(search_server)
+	, socket_path_(socket_path)
+{
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (socket_path_.size() >= sizeof(address.sun_path))
+	{
+		throw std::invalid_argument("Socket path is too long: "s + socket_path_);
+	}
+	std::memcpy(address.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+	listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd_ < 0)
+	{
+		throw LastError("Can't create a socket"s);
+	}
+	::unlink(socket_path_.c_str());
+	if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+		|| ::listen(listen_fd_, 16) != 0)
+	{
+		const std::system_error error = LastError("Can't listen on "s + socket_path_);
+		::close(listen_fd_);
+		throw error;
+	}
+}
+
+ShardWorker::~ShardWorker()
+{
+	::close(listen_fd_);
+	::unlink(socket_path_.c_str());
+}
+
+void ShardWorker::Run()
+{
+	while (!stopping_.load())
+	{
+		const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+			{
+				continue;
+			}
+			if (stopping_.load())
+			{
+				break;
+			}
+			throw LastError("accept failed"s);
+		}
+		connection_fd_.store(fd);
+		if (!stopping_.load())
+		{
+			Serve(fd);
+		}
+		connection_fd_.store(-1);
+		::close(fd);
+	}
+}
+
+void ShardWorker::Stop()
+{
+	stopping_.store(true);
+	// Wakes up accept() and the read of a connection
+	::shutdown(listen_fd_, SHUT_RDWR);
+	const int connection_fd = connection_fd_.load();
+	if (connection_fd >= 0)
+	{
+		::shutdown(connection_fd, SHUT_RDWR);
+	}
+}
+
+void ShardWorker::Serve(int fd)
+{
+	std::string frame;
+	std::string output;
+	ShardMessage request;
+	while (!stopping_.load() && ReadShardFrame(fd, frame))
+	{
+		if (!ParseShardMessage(frame, request))
+		{
+			// The stream can't be trusted past a malformed frame
+			return;
+		}
+
+		ShardMessage response;
+		response.request_id = request.request_id;
+		try
+		{
+			switch (request.type)
+			{
+			case ShardMessageType::STATS_REQUEST:
+				response.type = ShardMessageType::STATS_RESPONSE;
+				response.stats = search_server_.GetCollectionStats(request.text);
+				break;
+			case ShardMessageType::SEARCH_REQUEST:
+				response.type = ShardMessageType::SEARCH_RESPONSE;
+				response.documents = request.scorer == ShardScorer::BM25
+					? search_server_.FindTopDocuments<Bm25Scorer>(request.text, request.status, request.stats, request.count)
+					: search_server_.FindTopDocuments<TfIdfScorer>(request.text, request.status, request.stats, request.count);
+				break;
+			default:
+				response.type = ShardMessageType::ERROR_RESPONSE;
+				response.text = "Unexpected message"s;
+				break;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			response = {};
+			response.type = ShardMessageType::ERROR_RESPONSE;
+			response.request_id = request.request_id;
+			response.text = e.what();
+		}
+
+		output.clear();
+		AppendShardMessage(output, response);
+		if (!WriteShardFrames(fd, output))
+		{
+			return;
+		}
+	}
+}
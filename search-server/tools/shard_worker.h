@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "../search_server.h"
+
+// Serves one partition of a collection to a ShardCoordinator over a Unix
+// domain socket, see shard_protocol.h. Connections are served one at a time
+// and their requests in order: the coordinator keeps a single connection
+// and waits for every answer.
+class ShardWorker
+{
+public:
+	// Listens on socket_path, replacing a stale socket file
+	ShardWorker(const SearchServer& search_server, const std::string& socket_path);
+	~ShardWorker();
+
+	ShardWorker(const ShardWorker&) = delete;
+	ShardWorker& operator=(const ShardWorker&) = delete;
+
+	// Serves until Stop()
+	void Run();
+
+	// Async-signal-safe
+	void Stop();
+
+private:
+	const SearchServer& search_server_;
+	const std::string socket_path_;
+	int listen_fd_ = -1;
+	// The connection being served, -1 between connections
+	std::atomic<int> connection_fd_{ -1 };
+	std::atomic<bool> stopping_{ false };
+
+	void Serve(int fd);
+};
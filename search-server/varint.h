@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// LEB128 variable length integers: 7 bits per byte, high bit marks continuation
+
+inline void AppendVarint(std::string& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+// Consumes one varint from the front of `in`, returns false on truncated input
+inline bool ReadVarint(std::string_view& in, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && !in.empty(); shift += 7)
+	{
+		const uint8_t byte = static_cast<uint8_t>(in.front());
+		in.remove_prefix(1);
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}